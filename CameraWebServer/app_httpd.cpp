@@ -11,6 +11,7 @@
 // WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
 // See the License for the specific language governing permissions and
 // limitations under the License.
+#include <stdarg.h>
 #include "esp_http_server.h"
 #include "esp_timer.h"
 #include "esp_camera.h"
@@ -20,6 +21,13 @@
 #include "sdkconfig.h"
 #include "camera_index.h"
 #include "board_config.h"
+#include "clock_sync.h"
+#include "lwip/sockets.h"
+#include "frame_hub.h"
+#include "frame_pool.h"
+#include "bmp_stream.h"
+#include "stream_rate.h"
+#include "stream_metrics.h"
 
 #if defined(ARDUINO_ARCH_ESP32) && defined(CONFIG_ARDUHAL_ESP_LOG)
 #include "esp32-hal-log.h"
@@ -40,13 +48,36 @@ typedef struct {
 } jpg_chunking_t;
 
 #define PART_BOUNDARY "123456789000000000000987654321"
-static const char *_STREAM_CONTENT_TYPE = "multipart/x-mixed-replace;boundary=" PART_BOUNDARY;
+// /stream writes straight to the socket, so it sends its own response head.
+static const char _STREAM_RESPONSE[] = "HTTP/1.1 200 OK\r\n"
+                                       "Content-Type: multipart/x-mixed-replace;boundary=" PART_BOUNDARY "\r\n"
+                                       "Access-Control-Allow-Origin: *\r\n"
+                                       "X-Framerate: 60\r\n"
+                                       "Cache-Control: no-cache\r\n"
+                                       "Connection: close\r\n"
+                                       "\r\n";
 static const char *_STREAM_BOUNDARY = "\r\n--" PART_BOUNDARY "\r\n";
-static const char *_STREAM_PART = "Content-Type: image/jpeg\r\nContent-Length: %u\r\nX-Timestamp: %d.%06d\r\n\r\n";
+static const char *_STREAM_PART = "Content-Type: image/jpeg\r\nContent-Length: %u\r\nX-Timestamp: %d.%06d\r\n";
+static const char *_STREAM_PHONE_TS = "X-Phone-Timestamp: %lld\r\n";
+static const char *_STREAM_RATE = "X-Quality: %d\r\nX-Skip: %u\r\nX-Send-Us: %u\r\n";
 
 httpd_handle_t stream_httpd = NULL;
 httpd_handle_t camera_httpd = NULL;
 
+// Bumped by anything that changes what /status reports; regs_changes also
+// forces the shadowed sensor registers to be read again. Bumped from the
+// server and capture tasks, so only through __atomic ops. Call after the
+// write, so a /status racing it can't cache the old value as current.
+static uint32_t status_changes = 1;
+static uint32_t regs_changes = 1;
+
+static void status_invalidate(bool regs) {
+  __atomic_fetch_add(&status_changes, 1, __ATOMIC_RELEASE);
+  if (regs) {
+    __atomic_fetch_add(&regs_changes, 1, __ATOMIC_RELEASE);
+  }
+}
+
 typedef struct {
   size_t size;   //number of values used for filtering
   size_t index;  //current value index
@@ -55,8 +86,6 @@ typedef struct {
   int *values;  //array to be filled with values
 } ra_filter_t;
 
-static ra_filter_t ra_filter;
-
 static ra_filter_t *ra_filter_init(ra_filter_t *filter, size_t sample_size) {
   memset(filter, 0, sizeof(ra_filter_t));
 
@@ -100,9 +129,70 @@ void enable_led(bool en) {  // Turn LED On or Off
 }
 #endif
 
+// snprintf onto the end of buf, advancing *len. False (and *len left
+// alone) if it didn't fit, so callers never index past the buffer.
+static bool buf_appendf(char *buf, size_t size, size_t *len, const char *fmt, ...) {
+  if (*len >= size) {
+    return false;
+  }
+  va_list ap;
+  va_start(ap, fmt);
+  int n = vsnprintf(buf + *len, size - *len, fmt, ap);
+  va_end(ap);
+  if (n < 0 || (size_t)n >= size - *len) {
+    buf[*len] = '\0';
+    return false;
+  }
+  *len += n;
+  return true;
+}
+
+typedef struct {
+  httpd_req_t *req;
+  bool started;  // something has gone out, so an error status no longer can
+} chunk_out_t;
+
+static bool send_chunk(void *arg, const uint8_t *data, size_t len) {
+  chunk_out_t *c = (chunk_out_t *)arg;
+  c->started = true;
+  return httpd_resp_send_chunk(c->req, (const char *)data, len) == ESP_OK;
+}
+
+// Copy a JPEG frame out of the driver's buffer and give the buffer back,
+// so a slow client doesn't hold one of the few the camera has for the
+// whole transfer. Raw frames are width x height x 2-3 bytes, too big to
+// copy for that; they stay in the driver's buffer. False (fb still held)
+// for raw frames or if there's no memory for the copy.
+static bool fb_detach(camera_fb_t *fb, camera_fb_t *copy) {
+  if (fb->format != PIXFORMAT_JPEG) {
+    return false;
+  }
+  size_t cap;
+  uint8_t *buf = frame_pool_get(fb->len, &cap);
+  if (!buf) {
+    return false;
+  }
+  memcpy(buf, fb->buf, fb->len);
+  *copy = *fb;
+  copy->buf = buf;
+  esp_camera_fb_return(fb);
+  return true;
+}
+
+// Undo fb_detach(), or return the driver's buffer if it didn't happen.
+static void fb_release(camera_fb_t *fb, bool detached) {
+  if (!detached) {
+    esp_camera_fb_return(fb);
+    return;
+  }
+  frame_pool_put(fb->buf);
+  if (frame_hub_get_stats().subscribers == 0) {
+    frame_pool_trim();  // no stream to reuse it
+  }
+}
+
 static esp_err_t bmp_handler(httpd_req_t *req) {
   camera_fb_t *fb = NULL;
-  esp_err_t res = ESP_OK;
 #if ARDUHAL_LOG_LEVEL >= ARDUHAL_LOG_LEVEL_INFO
   uint64_t fr_start = esp_timer_get_time();
 #endif
@@ -121,21 +211,77 @@ static esp_err_t bmp_handler(httpd_req_t *req) {
   snprintf(ts, 32, "%lld.%06ld", fb->timestamp.tv_sec, fb->timestamp.tv_usec);
   httpd_resp_set_hdr(req, "X-Timestamp", (const char *)ts);
 
-  uint8_t *buf = NULL;
-  size_t buf_len = 0;
-  bool converted = frame2bmp(fb, &buf, &buf_len);
-  esp_camera_fb_return(fb);
-  if (!converted) {
+  // Decode from a copy of the JPEG (small) so the camera gets its buffer
+  // back right away; raw frames are converted from the driver's buffer.
+  camera_fb_t copy;
+  bool detached = fb_detach(fb, &copy);
+  if (detached) {
+    fb = &copy;
+  }
+
+  // Header first, then rows as they're converted; nothing frame-sized is
+  // allocated.
+  chunk_out_t out = {req, false};
+  bool ok = bmp_stream(fb, send_chunk, &out);
+  fb_release(fb, detached);
+  if (!ok) {
     log_e("BMP Conversion failed");
-    httpd_resp_send_500(req);
-    return ESP_FAIL;
+    if (!out.started) {
+      httpd_resp_send_500(req);  // bad format or out of memory; nothing sent yet
+    }
+    return ESP_FAIL;  // otherwise headers are out; dropping the socket is all that's left
   }
-  res = httpd_resp_send(req, (const char *)buf, buf_len);
-  free(buf);
+  httpd_resp_send_chunk(req, NULL, 0);
 #if ARDUHAL_LOG_LEVEL >= ARDUHAL_LOG_LEVEL_INFO
   uint64_t fr_end = esp_timer_get_time();
 #endif
-  log_i("BMP: %llums, %uB", (uint64_t)((fr_end - fr_start) / 1000), buf_len);
+  log_i("BMP: %llums", (uint64_t)((fr_end - fr_start) / 1000));
+  return ESP_OK;
+}
+
+// The frame buffer exactly as the sensor delivered it, for grayscale,
+// RGB565, YUV422 and RGB888 modes. X-Width, X-Height and X-Format
+// describe the layout.
+static esp_err_t raw_handler(httpd_req_t *req) {
+  camera_fb_t *fb = esp_camera_fb_get();
+  if (!fb) {
+    log_e("Camera capture failed");
+    httpd_resp_send_500(req);
+    return ESP_FAIL;
+  }
+  size_t rows = raw_rows_per_chunk(fb);
+  if (rows == 0) {
+    esp_camera_fb_return(fb);
+    httpd_resp_set_status(req, "409 Conflict");
+    return httpd_resp_send(req, "Sensor is not in a raw pixel format", HTTPD_RESP_USE_STRLEN);
+  }
+
+  char hdr[3][32];
+  httpd_resp_set_type(req, "application/octet-stream");
+  httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
+  snprintf(hdr[0], sizeof(hdr[0]), "%u", (unsigned)fb->width);
+  httpd_resp_set_hdr(req, "X-Width", hdr[0]);
+  snprintf(hdr[1], sizeof(hdr[1]), "%u", (unsigned)fb->height);
+  httpd_resp_set_hdr(req, "X-Height", hdr[1]);
+  httpd_resp_set_hdr(req, "X-Format", fb->format == PIXFORMAT_GRAYSCALE ? "gray"
+                                      : fb->format == PIXFORMAT_RGB565  ? "rgb565"
+                                      : fb->format == PIXFORMAT_YUV422  ? "yuv422"
+                                                                        : "rgb888");
+  snprintf(hdr[2], sizeof(hdr[2]), "%lld.%06ld", fb->timestamp.tv_sec, fb->timestamp.tv_usec);
+  httpd_resp_set_hdr(req, "X-Timestamp", hdr[2]);
+
+  // Straight from the driver's buffer, a block of rows per chunk; a copy
+  // would be as big as the frame itself.
+  size_t block = rows * fb->width * raw_bytes_per_pixel(fb->format);
+  esp_err_t res = ESP_OK;
+  for (size_t off = 0; res == ESP_OK && off < fb->len; off += block) {
+    size_t n = fb->len - off < block ? fb->len - off : block;
+    res = httpd_resp_send_chunk(req, (const char *)fb->buf + off, n);
+  }
+  esp_camera_fb_return(fb);
+  if (res == ESP_OK) {
+    res = httpd_resp_send_chunk(req, NULL, 0);
+  }
   return res;
 }
 
@@ -151,6 +297,44 @@ static size_t jpg_encode_stream(void *arg, size_t index, const void *data, size_
   return len;
 }
 
+#if defined(LED_GPIO_NUM)
+#define FLASH_TIMEOUT_MS    1000
+#define FLASH_SETTLE_FRAMES 1     // whole frames between LED on and the one we keep
+
+// Light the LED and keep the first frame exposed entirely under it.
+//
+// The driver stamps each frame at VSYNC, so the timestamp says when its
+// exposure window began. Frames that started before the LED came on
+// (including stale ones queued by CAMERA_GRAB_LATEST) go straight back.
+// The first frame starting after it can still have its top rows exposed
+// during the previous readout, so one more frame is allowed to settle.
+static camera_fb_t *flash_capture(int64_t *wait_us, int *flushed) {
+  int64_t on_us = esp_timer_get_time();
+  enable_led(true);
+
+  camera_fb_t *fb = NULL;
+  int after_on = 0;
+  *flushed = 0;
+  while ((fb = esp_camera_fb_get()) != NULL) {
+    int64_t start_us = (int64_t)fb->timestamp.tv_sec * 1000000 + fb->timestamp.tv_usec;
+    if (start_us >= on_us && after_on++ >= FLASH_SETTLE_FRAMES) {
+      break;
+    }
+    if (esp_timer_get_time() - on_us > FLASH_TIMEOUT_MS * 1000) {
+      break;  // sensor isn't keeping up; take what we have
+    }
+    esp_camera_fb_return(fb);
+    (*flushed)++;
+  }
+
+  if (!isStreaming) {
+    enable_led(false);
+  }
+  *wait_us = esp_timer_get_time() - on_us;
+  return fb;
+}
+#endif
+
 static esp_err_t capture_handler(httpd_req_t *req) {
   camera_fb_t *fb = NULL;
   esp_err_t res = ESP_OK;
@@ -159,10 +343,13 @@ static esp_err_t capture_handler(httpd_req_t *req) {
 #endif
 
 #if defined(LED_GPIO_NUM)
-  enable_led(true);
-  vTaskDelay(150 / portTICK_PERIOD_MS);  // The LED needs to be turned on ~150ms before the call to esp_camera_fb_get()
-  fb = esp_camera_fb_get();              // or it won't be visible in the frame. A better way to do this is needed.
-  enable_led(false);
+  int64_t flash_wait_us = 0;
+  int flash_flushed = 0;
+  if (led_duty > 0) {
+    fb = flash_capture(&flash_wait_us, &flash_flushed);
+  } else {
+    fb = esp_camera_fb_get();
+  }
 #else
   fb = esp_camera_fb_get();
 #endif
@@ -181,6 +368,27 @@ static esp_err_t capture_handler(httpd_req_t *req) {
   snprintf(ts, 32, "%lld.%06ld", fb->timestamp.tv_sec, fb->timestamp.tv_usec);
   httpd_resp_set_hdr(req, "X-Timestamp", (const char *)ts);
 
+  char phone_ts[24];
+  clock_sync_t cs = clock_sync_snapshot();
+  if (cs.valid) {
+    int64_t local_us = (int64_t)fb->timestamp.tv_sec * 1000000 + fb->timestamp.tv_usec;
+    snprintf(phone_ts, sizeof(phone_ts), "%lld", clock_sync_to_phone_us(&cs, local_us));
+    httpd_resp_set_hdr(req, "X-Phone-Timestamp", (const char *)phone_ts);
+  }
+
+#if defined(LED_GPIO_NUM)
+  // Measured time from LED on to the kept frame being ready, and how many
+  // frames were thrown away on the way, for comparing against the old
+  // fixed 150 ms delay from the client.
+  char flash_wait[12], flash_flushed_s[8];
+  if (led_duty > 0) {
+    snprintf(flash_wait, sizeof(flash_wait), "%d", (int)(flash_wait_us / 1000));
+    snprintf(flash_flushed_s, sizeof(flash_flushed_s), "%d", flash_flushed);
+    httpd_resp_set_hdr(req, "X-Flash-Wait-Ms", flash_wait);
+    httpd_resp_set_hdr(req, "X-Flash-Flushed", flash_flushed_s);
+  }
+#endif
+
 #if ARDUHAL_LOG_LEVEL >= ARDUHAL_LOG_LEVEL_INFO
   size_t fb_len = 0;
 #endif
@@ -205,96 +413,207 @@ static esp_err_t capture_handler(httpd_req_t *req) {
   return res;
 }
 
-static esp_err_t stream_handler(httpd_req_t *req) {
-  camera_fb_t *fb = NULL;
-  struct timeval _timestamp;
-  esp_err_t res = ESP_OK;
-  size_t _jpg_buf_len = 0;
-  uint8_t *_jpg_buf = NULL;
-  char *part_buf[128];
+// Each /stream client gets its own sender task fed by the frame hub, so
+// clients don't compete for camera buffers and a slow one only drops its
+// own frames.
+#define STREAM_TASK_STACK     4096
+#define STREAM_TASK_PRIORITY  5
+#define STREAM_FRAME_WAIT_MS  1000
 
-  static int64_t last_frame = 0;
-  if (!last_frame) {
-    last_frame = esp_timer_get_time();
-  }
+typedef struct {
+  httpd_req_t *req;
+  frame_sub_t *sub;
+  stream_rate_t rate;
+  ra_filter_t frame_avg;  // this stream's frame times, for the log
+} stream_ctx_t;
 
-  res = httpd_resp_set_type(req, _STREAM_CONTENT_TYPE);
-  if (res != ESP_OK) {
-    return res;
-  }
+// The quality last asked for through /control; the stream rate controller
+// only ever lowers quality from here. -1 until read from the sensor.
+static int stream_base_quality = -1;
 
-  httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
-  httpd_resp_set_hdr(req, "X-Framerate", "60");
+// Runs on the capture task between frames.
+static void stream_apply_quality(void) {
+  sensor_t *s = esp_camera_sensor_get();
+  if (!s || s->pixformat != PIXFORMAT_JPEG) {
+    return;
+  }
+  if (stream_base_quality < 0) {
+    stream_base_quality = s->status.quality;
+  }
+  int q = stream_rate_quality(stream_base_quality, stream_rate_shared_level());
+  if (q != s->status.quality) {
+    s->set_quality(s, q);
+    status_invalidate(false);
+  }
+}
 
 #if defined(LED_GPIO_NUM)
-  isStreaming = true;
-  enable_led(true);
+static portMUX_TYPE stream_count_lock = portMUX_INITIALIZER_UNLOCKED;
+static int stream_count = 0;
+
+static void stream_led_update(int delta) {
+  portENTER_CRITICAL(&stream_count_lock);
+  stream_count += delta;
+  bool on = stream_count > 0;
+  portEXIT_CRITICAL(&stream_count_lock);
+  isStreaming = on;
+  enable_led(on);
+}
 #endif
 
-  while (true) {
-    fb = esp_camera_fb_get();
-    if (!fb) {
-      log_e("Camera capture failed");
-      res = ESP_FAIL;
-    } else {
-      _timestamp.tv_sec = fb->timestamp.tv_sec;
-      _timestamp.tv_usec = fb->timestamp.tv_usec;
-      if (fb->format != PIXFORMAT_JPEG) {
-        bool jpeg_converted = frame2jpg(fb, 80, &_jpg_buf, &_jpg_buf_len);
-        esp_camera_fb_return(fb);
-        fb = NULL;
-        if (!jpeg_converted) {
-          log_e("JPEG compression failed");
-          res = ESP_FAIL;
-        }
-      } else {
-        _jpg_buf_len = fb->len;
-        _jpg_buf = fb->buf;
-      }
-    }
-    if (res == ESP_OK) {
-      res = httpd_resp_send_chunk(req, _STREAM_BOUNDARY, strlen(_STREAM_BOUNDARY));
-    }
-    if (res == ESP_OK) {
-      size_t hlen = snprintf((char *)part_buf, 128, _STREAM_PART, _jpg_buf_len, _timestamp.tv_sec, _timestamp.tv_usec);
-      res = httpd_resp_send_chunk(req, (const char *)part_buf, hlen);
-    }
-    if (res == ESP_OK) {
-      res = httpd_resp_send_chunk(req, (const char *)_jpg_buf, _jpg_buf_len);
-    }
-    if (fb) {
-      esp_camera_fb_return(fb);
-      fb = NULL;
-      _jpg_buf = NULL;
-    } else if (_jpg_buf) {
-      free(_jpg_buf);
-      _jpg_buf = NULL;
-    }
-    if (res != ESP_OK) {
+static void stream_record_sent(const frame_t *frame, int64_t send_start, int64_t sent_us) {
+  int64_t sensor_us = (int64_t)frame->timestamp.tv_sec * 1000000 + frame->timestamp.tv_usec;
+  metrics_record(METRIC_SEND, sent_us - frame->ready_us);
+  metrics_record(METRIC_TOTAL, sent_us - sensor_us);
+  metrics_frame_sent(frame->seq, (uint32_t)(sent_us - send_start));
+}
+
+// Write all of iov to the socket, picking up after partial writes. Each
+// call is counted, so /metrics shows writes per frame (socketWrites/sent).
+static bool stream_writev(int fd, struct iovec *iov, int iovcnt) {
+  while (iovcnt > 0) {
+    ssize_t n = lwip_writev(fd, iov, iovcnt);
+    metrics_socket_write();
+    if (n < 0) {
+      return false;
+    }
+    while (iovcnt > 0 && (size_t)n >= iov->iov_len) {
+      n -= iov->iov_len;
+      iov++;
+      iovcnt--;
+    }
+    if (iovcnt > 0) {
+      iov->iov_base = (uint8_t *)iov->iov_base + n;
+      iov->iov_len -= n;
+    }
+  }
+  return true;
+}
+
+static void stream_task(void *arg) {
+  stream_ctx_t *ctx = (stream_ctx_t *)arg;
+  httpd_req_t *req = ctx->req;
+  httpd_handle_t hd = req->handle;
+  int fd = httpd_req_to_sockfd(req);
+  // Boundary and part headers for one frame, built in one place so they go
+  // out with the JPEG in a single write.
+  char part_buf[256];
+  int64_t last_frame = esp_timer_get_time();
+
+  // Each frame is a single write, so there's nothing for Nagle to merge.
+  int nodelay = 1;
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+
+  struct iovec head = {(void *)_STREAM_RESPONSE, sizeof(_STREAM_RESPONSE) - 1};
+  bool ok = stream_writev(fd, &head, 1);
+
+  while (ok) {
+    frame_t *frame = frame_hub_wait(ctx->sub, pdMS_TO_TICKS(STREAM_FRAME_WAIT_MS));
+    if (!frame) {
+      continue;  // capture stalled; keep the connection
+    }
+    if (!stream_rate_should_send(&ctx->rate)) {
+      metrics_frame_skipped();
+      frame_release(frame);
+      continue;
+    }
+
+    size_t hlen = strlen(_STREAM_BOUNDARY);
+    memcpy(part_buf, _STREAM_BOUNDARY, hlen);
+    bool fits = buf_appendf(part_buf, sizeof(part_buf), &hlen, _STREAM_PART, frame->len, frame->timestamp.tv_sec, frame->timestamp.tv_usec);
+    clock_sync_t cs = clock_sync_snapshot();
+    if (fits && cs.valid) {
+      int64_t local_us = (int64_t)frame->timestamp.tv_sec * 1000000 + frame->timestamp.tv_usec;
+      fits = buf_appendf(part_buf, sizeof(part_buf), &hlen, _STREAM_PHONE_TS, clock_sync_to_phone_us(&cs, local_us));
+    }
+    fits = fits && buf_appendf(part_buf, sizeof(part_buf), &hlen, _STREAM_RATE, frame->quality, stream_rate_skip(&ctx->rate), ctx->rate.send_avg_us);
+    fits = fits && buf_appendf(part_buf, sizeof(part_buf), &hlen, "\r\n");
+    if (!fits) {
+      log_e("Part header too long");
+      frame_release(frame);
+      break;
+    }
+
+    struct iovec iov[2] = {
+      {part_buf, hlen},
+      {frame->buf, frame->len},
+    };
+    int64_t send_start = esp_timer_get_time();
+    ok = stream_writev(fd, iov, 2);
+    if (!ok) {
+      frame_release(frame);
       log_e("Send frame failed");
       break;
     }
+
     int64_t fr_end = esp_timer_get_time();
+    stream_rate_sample(&ctx->rate, (uint32_t)(fr_end - send_start));
+    stream_record_sent(frame, send_start, fr_end);
 
     int64_t frame_time = fr_end - last_frame;
     last_frame = fr_end;
 
     frame_time /= 1000;
 #if ARDUHAL_LOG_LEVEL >= ARDUHAL_LOG_LEVEL_INFO
-    uint32_t avg_frame_time = ra_filter_run(&ra_filter, frame_time);
+    uint32_t avg_frame_time = ra_filter_run(&ctx->frame_avg, frame_time);
 #endif
     log_i(
-      "MJPG: %uB %ums (%.1ffps), AVG: %ums (%.1ffps)", (uint32_t)(_jpg_buf_len), (uint32_t)frame_time, 1000.0 / (uint32_t)frame_time, avg_frame_time,
-      1000.0 / avg_frame_time
+      "MJPG: %uB %ums (%.1ffps), AVG: %ums (%.1ffps), dropped %u", (uint32_t)(frame->len), (uint32_t)frame_time, 1000.0 / (uint32_t)frame_time, avg_frame_time,
+      1000.0 / avg_frame_time, frame_sub_dropped(ctx->sub)
     );
+    frame_release(frame);
   }
 
+  stream_rate_close(&ctx->rate);
+  frame_hub_unsubscribe(ctx->sub);
 #if defined(LED_GPIO_NUM)
-  isStreaming = false;
-  enable_led(false);
+  stream_led_update(-1);
 #endif
+  httpd_req_async_handler_complete(req);
+  // The server never saw our response, so it won't close the socket itself.
+  httpd_sess_trigger_close(hd, fd);
+  free(ctx->frame_avg.values);
+  free(ctx);
+  vTaskDelete(NULL);
+}
 
-  return res;
+static esp_err_t stream_handler(httpd_req_t *req) {
+  frame_sub_t *sub = frame_hub_subscribe();
+  if (!sub) {
+    httpd_resp_set_status(req, "503 Service Unavailable");
+    return httpd_resp_send(req, "Stream unavailable", HTTPD_RESP_USE_STRLEN);
+  }
+
+  stream_ctx_t *ctx = (stream_ctx_t *)malloc(sizeof(stream_ctx_t));
+  httpd_req_t *async_req = NULL;
+  if (!ctx || httpd_req_async_handler_begin(req, &async_req) != ESP_OK) {
+    free(ctx);
+    frame_hub_unsubscribe(sub);
+    return httpd_resp_send_500(req);
+  }
+  ctx->req = async_req;
+  ctx->sub = sub;
+  stream_rate_open(&ctx->rate, STREAM_RATE_TARGET_US);
+  ra_filter_init(&ctx->frame_avg, 20);  // without values the log shows raw times
+
+#if defined(LED_GPIO_NUM)
+  stream_led_update(1);
+#endif
+
+  // The sender task owns the connection from here; the server task is
+  // free for the next client.
+  if (xTaskCreatePinnedToCore(stream_task, "stream", STREAM_TASK_STACK, ctx, STREAM_TASK_PRIORITY, NULL, FRAME_HUB_SEND_CORE) != pdPASS) {
+#if defined(LED_GPIO_NUM)
+    stream_led_update(-1);
+#endif
+    stream_rate_close(&ctx->rate);
+    frame_hub_unsubscribe(sub);
+    httpd_req_async_handler_complete(async_req);
+    free(ctx->frame_avg.values);
+    free(ctx);
+    return ESP_FAIL;
+  }
+  return ESP_OK;
 }
 
 static esp_err_t parse_get(httpd_req_t *req, char **obuf) {
@@ -318,6 +637,140 @@ static esp_err_t parse_get(httpd_req_t *req, char **obuf) {
   return ESP_FAIL;
 }
 
+// /control settings, looked up through a perfect hash built at compile
+// time: one FNV-1a hash and one strcmp per name instead of a strcmp chain.
+typedef int (*control_fn_t)(sensor_t *s, int val);
+
+typedef struct {
+  const char *name;
+  control_fn_t apply;
+} control_t;
+
+static constexpr control_t controls[] = {
+  {"framesize", [](sensor_t *s, int v) { return s->pixformat == PIXFORMAT_JPEG ? s->set_framesize(s, (framesize_t)v) : 0; }},
+  {"quality", [](sensor_t *s, int v) { stream_base_quality = v; return s->set_quality(s, v); }},
+  {"contrast", [](sensor_t *s, int v) { return s->set_contrast(s, v); }},
+  {"brightness", [](sensor_t *s, int v) { return s->set_brightness(s, v); }},
+  {"saturation", [](sensor_t *s, int v) { return s->set_saturation(s, v); }},
+  {"gainceiling", [](sensor_t *s, int v) { return s->set_gainceiling(s, (gainceiling_t)v); }},
+  {"colorbar", [](sensor_t *s, int v) { return s->set_colorbar(s, v); }},
+  {"awb", [](sensor_t *s, int v) { return s->set_whitebal(s, v); }},
+  {"agc", [](sensor_t *s, int v) { return s->set_gain_ctrl(s, v); }},
+  {"aec", [](sensor_t *s, int v) { return s->set_exposure_ctrl(s, v); }},
+  {"hmirror", [](sensor_t *s, int v) { return s->set_hmirror(s, v); }},
+  {"vflip", [](sensor_t *s, int v) { return s->set_vflip(s, v); }},
+  {"awb_gain", [](sensor_t *s, int v) { return s->set_awb_gain(s, v); }},
+  {"agc_gain", [](sensor_t *s, int v) { return s->set_agc_gain(s, v); }},
+  {"aec_value", [](sensor_t *s, int v) { return s->set_aec_value(s, v); }},
+  {"aec2", [](sensor_t *s, int v) { return s->set_aec2(s, v); }},
+  {"dcw", [](sensor_t *s, int v) { return s->set_dcw(s, v); }},
+  {"bpc", [](sensor_t *s, int v) { return s->set_bpc(s, v); }},
+  {"wpc", [](sensor_t *s, int v) { return s->set_wpc(s, v); }},
+  {"raw_gma", [](sensor_t *s, int v) { return s->set_raw_gma(s, v); }},
+  {"lenc", [](sensor_t *s, int v) { return s->set_lenc(s, v); }},
+  {"special_effect", [](sensor_t *s, int v) { return s->set_special_effect(s, v); }},
+  {"wb_mode", [](sensor_t *s, int v) { return s->set_wb_mode(s, v); }},
+  {"ae_level", [](sensor_t *s, int v) { return s->set_ae_level(s, v); }},
+#if defined(LED_GPIO_NUM)
+  {"led_intensity", [](sensor_t *s, int v) {
+     led_duty = v;
+     if (isStreaming) {
+       enable_led(true);
+     }
+     return 0;
+   }},
+#endif
+};
+
+#define CONTROL_COUNT (sizeof(controls) / sizeof(controls[0]))
+#define CONTROL_SLOTS 128
+#define CONTROL_SEED  5  // picked so the names above don't collide
+
+static constexpr uint32_t control_hash(const char *name) {
+  uint32_t h = 2166136261u ^ CONTROL_SEED;
+  while (*name) {
+    h = (h ^ (uint8_t)*name++) * 16777619u;
+  }
+  return h;
+}
+
+typedef struct {
+  int8_t index[CONTROL_SLOTS];  // into controls[], -1 empty, -2 collision
+} control_slots_t;
+
+static constexpr control_slots_t control_build_slots() {
+  control_slots_t t = {};
+  for (int i = 0; i < CONTROL_SLOTS; i++) {
+    t.index[i] = -1;
+  }
+  for (size_t i = 0; i < CONTROL_COUNT; i++) {
+    uint32_t slot = control_hash(controls[i].name) % CONTROL_SLOTS;
+    t.index[slot] = t.index[slot] == -1 ? (int8_t)i : -2;
+  }
+  return t;
+}
+
+static constexpr control_slots_t control_slots = control_build_slots();
+
+static constexpr bool control_slots_perfect() {
+  for (int i = 0; i < CONTROL_SLOTS; i++) {
+    if (control_slots.index[i] == -2) {
+      return false;
+    }
+  }
+  return true;
+}
+static_assert(control_slots_perfect(), "control names collide; pick another CONTROL_SEED");
+
+static const control_t *find_control(const char *name) {
+  int i = control_slots.index[control_hash(name) % CONTROL_SLOTS];
+  if (i < 0 || strcmp(controls[i].name, name)) {
+    return NULL;
+  }
+  return &controls[i];
+}
+
+// Apply one /control setting. Negative on failure or an unknown name.
+static int set_control(const char *variable, int val) {
+  log_i("%s = %d", variable, val);
+  const control_t *c = find_control(variable);
+  if (!c) {
+    log_i("Unknown command: %s", variable);
+    return -1;
+  }
+  int res = c->apply(esp_camera_sensor_get(), val);
+  // Setters can touch registers the status shadows (aec, agc, ...).
+  status_invalidate(true);
+  return res;
+}
+
+// Walk a query string's key=value pairs in order. Returns false at the
+// end; keys and values longer than their buffers are truncated.
+static bool next_query_pair(const char **q, char *key, size_t key_len, char *val, size_t val_len) {
+  const char *p = *q;
+  if (!*p) {
+    return false;
+  }
+  const char *amp = strchr(p, '&');
+  const char *end = amp ? amp : p + strlen(p);
+  const char *eq = (const char *)memchr(p, '=', end - p);
+  const char *kend = eq ? eq : end;
+  size_t n = kend - p < (ptrdiff_t)key_len - 1 ? kend - p : key_len - 1;
+  memcpy(key, p, n);
+  key[n] = 0;
+  n = 0;
+  if (eq) {
+    n = end - (eq + 1) < (ptrdiff_t)val_len - 1 ? end - (eq + 1) : val_len - 1;
+    memcpy(val, eq + 1, n);
+  }
+  val[n] = 0;
+  *q = amp ? amp + 1 : end;
+  return true;
+}
+
+// /control?var=<name>&val=<n> sets one control, as before.
+// /control?<name>=<n>&<name>=<n>... applies a whole profile in order and
+// reports {"applied":<n>,"failed":["<name>",...]}.
 static esp_err_t cmd_handler(httpd_req_t *req) {
   char *buf = NULL;
   char variable[32];
@@ -326,128 +779,455 @@ static esp_err_t cmd_handler(httpd_req_t *req) {
   if (parse_get(req, &buf) != ESP_OK) {
     return ESP_FAIL;
   }
-  if (httpd_query_key_value(buf, "var", variable, sizeof(variable)) != ESP_OK || httpd_query_key_value(buf, "val", value, sizeof(value)) != ESP_OK) {
+  httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
+
+  if (httpd_query_key_value(buf, "var", variable, sizeof(variable)) == ESP_OK) {
+    if (httpd_query_key_value(buf, "val", value, sizeof(value)) != ESP_OK) {
+      free(buf);
+      httpd_resp_send_404(req);
+      return ESP_FAIL;
+    }
     free(buf);
-    httpd_resp_send_404(req);
-    return ESP_FAIL;
+    if (set_control(variable, atoi(value)) < 0) {
+      return httpd_resp_send_500(req);
+    }
+    return httpd_resp_send(req, NULL, 0);
+  }
+
+  // Failed names fill the buffer up to the room kept for the closing
+  // "],\"applied\":<int>}"; names that don't fit are left out of the list.
+  char json_response[256];
+  const size_t names_max = sizeof(json_response) - 32;
+  size_t len = 0;
+  int applied = 0, failed = 0, listed = 0;
+  buf_appendf(json_response, names_max, &len, "{\"failed\":[");
+  const char *q = buf;
+  while (next_query_pair(&q, variable, sizeof(variable), value, sizeof(value))) {
+    if (set_control(variable, atoi(value)) >= 0) {
+      applied++;
+      continue;
+    }
+    if (buf_appendf(json_response, names_max, &len, "%s\"%s\"", listed ? "," : "", variable)) {
+      listed++;
+    }
+    failed++;
   }
   free(buf);
+  if (!buf_appendf(json_response, sizeof(json_response), &len, "],\"applied\":%d}", applied)) {
+    return httpd_resp_send_500(req);  // can't happen with the room kept above
+  }
 
-  int val = atoi(value);
-  log_i("%s = %d", variable, val);
-  sensor_t *s = esp_camera_sensor_get();
-  int res = 0;
-
-  if (!strcmp(variable, "framesize")) {
-    if (s->pixformat == PIXFORMAT_JPEG) {
-      res = s->set_framesize(s, (framesize_t)val);
-    }
-  } else if (!strcmp(variable, "quality")) {
-    res = s->set_quality(s, val);
-  } else if (!strcmp(variable, "contrast")) {
-    res = s->set_contrast(s, val);
-  } else if (!strcmp(variable, "brightness")) {
-    res = s->set_brightness(s, val);
-  } else if (!strcmp(variable, "saturation")) {
-    res = s->set_saturation(s, val);
-  } else if (!strcmp(variable, "gainceiling")) {
-    res = s->set_gainceiling(s, (gainceiling_t)val);
-  } else if (!strcmp(variable, "colorbar")) {
-    res = s->set_colorbar(s, val);
-  } else if (!strcmp(variable, "awb")) {
-    res = s->set_whitebal(s, val);
-  } else if (!strcmp(variable, "agc")) {
-    res = s->set_gain_ctrl(s, val);
-  } else if (!strcmp(variable, "aec")) {
-    res = s->set_exposure_ctrl(s, val);
-  } else if (!strcmp(variable, "hmirror")) {
-    res = s->set_hmirror(s, val);
-  } else if (!strcmp(variable, "vflip")) {
-    res = s->set_vflip(s, val);
-  } else if (!strcmp(variable, "awb_gain")) {
-    res = s->set_awb_gain(s, val);
-  } else if (!strcmp(variable, "agc_gain")) {
-    res = s->set_agc_gain(s, val);
-  } else if (!strcmp(variable, "aec_value")) {
-    res = s->set_aec_value(s, val);
-  } else if (!strcmp(variable, "aec2")) {
-    res = s->set_aec2(s, val);
-  } else if (!strcmp(variable, "dcw")) {
-    res = s->set_dcw(s, val);
-  } else if (!strcmp(variable, "bpc")) {
-    res = s->set_bpc(s, val);
-  } else if (!strcmp(variable, "wpc")) {
-    res = s->set_wpc(s, val);
-  } else if (!strcmp(variable, "raw_gma")) {
-    res = s->set_raw_gma(s, val);
-  } else if (!strcmp(variable, "lenc")) {
-    res = s->set_lenc(s, val);
-  } else if (!strcmp(variable, "special_effect")) {
-    res = s->set_special_effect(s, val);
-  } else if (!strcmp(variable, "wb_mode")) {
-    res = s->set_wb_mode(s, val);
-  } else if (!strcmp(variable, "ae_level")) {
-    res = s->set_ae_level(s, val);
+  if (failed) {
+    httpd_resp_set_status(req, "500 Internal Server Error");
+  }
+  httpd_resp_set_type(req, "application/json");
+  return httpd_resp_send(req, json_response, len);
+}
+
+#ifdef CONFIG_HTTPD_WS_SUPPORT
+// /ws: video and controls on one WebSocket.
+//
+// Server to client, each frame is a binary message: a ws_frame_meta_t
+// followed by the JPEG. Client to server, text messages carry the same
+// var=<name>&val=<n> pairs as /control and are answered with a text
+// message {"var":"<name>","res":<n>}.
+//
+// As with /stream, a sender task per client writes straight to the socket
+// and is the only writer on it. Replies to controls, and the PONG/CLOSE
+// answers to control frames (which we handle rather than the server, so
+// it never writes on its own), are handed to it rather than sent from the
+// server task.
+#define WS_MAX_CLIENTS     FRAME_HUB_MAX_SUBS
+#define WS_FRAME_WAIT_MS   100  // also how long a control reply can wait
+#define WS_REPLIES         4
+#define WS_REPLY_MAX       125  // largest control frame payload
+#define WS_MSG_MAX         128
+
+#define WS_OP_TEXT   0x1
+#define WS_OP_BINARY 0x2
+#define WS_OP_CLOSE  0x8
+#define WS_OP_PONG   0xA
+#define WS_FIN       0x80
+
+// Little-endian, 28 bytes.
+typedef struct __attribute__((packed)) {
+  uint32_t seq;
+  uint32_t len;           // JPEG bytes following this header
+  int64_t timestamp_us;   // camera clock
+  int64_t phone_us;       // phone clock, 0 until /time has synced
+  uint8_t quality;
+  uint8_t skip;
+  uint16_t reserved;
+} ws_frame_meta_t;
+
+typedef struct {
+  bool in_use;
+  bool closing;  // the server dropped the session; the sender closes the fd
+  int fd;
+  httpd_handle_t hd;
+  frame_sub_t *sub;
+  stream_rate_t rate;
+  char replies[WS_REPLIES][WS_REPLY_MAX];
+  uint8_t reply_len[WS_REPLIES];
+  uint8_t reply_op[WS_REPLIES];
+  uint8_t reply_head;
+  uint8_t reply_count;
+  bool close_rx;     // the client sent CLOSE; answer it and end the session
+  uint8_t close_payload[2];
+  uint8_t close_len;
+} ws_client_t;
+
+static portMUX_TYPE ws_lock = portMUX_INITIALIZER_UNLOCKED;
+static ws_client_t ws_clients[WS_MAX_CLIENTS];
+
+// Server frames are unmasked, so the header is just opcode and length.
+static bool ws_send(int fd, uint8_t opcode, const void *a, size_t a_len, const void *b, size_t b_len) {
+  uint8_t hdr[10];
+  size_t hdr_len = 2;
+  uint64_t len = a_len + b_len;
+  hdr[0] = WS_FIN | opcode;
+  if (len < 126) {
+    hdr[1] = (uint8_t)len;
+  } else if (len <= 0xFFFF) {
+    hdr[1] = 126;
+    hdr[2] = (uint8_t)(len >> 8);
+    hdr[3] = (uint8_t)len;
+    hdr_len = 4;
+  } else {
+    hdr[1] = 127;
+    for (int i = 0; i < 8; i++) {
+      hdr[2 + i] = (uint8_t)(len >> (56 - 8 * i));
+    }
+    hdr_len = 10;
+  }
+  struct iovec iov[3] = {
+    {hdr, hdr_len},
+    {(void *)a, a_len},
+    {(void *)b, b_len},
+  };
+  return stream_writev(fd, iov, b_len ? 3 : 2);
+}
+
+static ws_client_t *ws_find(int fd) {
+  for (int i = 0; i < WS_MAX_CLIENTS; i++) {
+    if (ws_clients[i].in_use && ws_clients[i].fd == fd) {
+      return &ws_clients[i];
+    }
   }
+  return NULL;
+}
+
+// Hand a message to the client's sender. Dropped if its queue is full.
+static void ws_queue(int fd, uint8_t opcode, const void *data, size_t len) {
+  if (len > WS_REPLY_MAX) {
+    return;
+  }
+  portENTER_CRITICAL(&ws_lock);
+  ws_client_t *c = ws_find(fd);
+  if (c && c->reply_count < WS_REPLIES) {
+    int slot = (c->reply_head + c->reply_count) % WS_REPLIES;
+    memcpy(c->replies[slot], data, len);
+    c->reply_len[slot] = len;
+    c->reply_op[slot] = opcode;
+    c->reply_count++;
+  }
+  portEXIT_CRITICAL(&ws_lock);
+}
+
+static void ws_queue_reply(int fd, const char *variable, int res) {
+  char reply[WS_REPLY_MAX];
+  int len = snprintf(reply, sizeof(reply), "{\"var\":\"%s\",\"res\":%d}", variable, res);
+  if (len < 0 || len >= (int)sizeof(reply)) {
+    return;
+  }
+  ws_queue(fd, WS_OP_TEXT, reply, len);
+}
+
+// Unlike replies, a CLOSE is never dropped: it's a flag, not a queue entry.
+static void ws_queue_close(int fd, const uint8_t *payload, size_t len) {
+  portENTER_CRITICAL(&ws_lock);
+  ws_client_t *c = ws_find(fd);
+  if (c && !c->close_rx) {
+    c->close_rx = true;
+    c->close_len = len >= 2 ? 2 : 0;  // echo the status code only
+    memcpy(c->close_payload, payload, c->close_len);
+  }
+  portEXIT_CRITICAL(&ws_lock);
+}
+
+// Take the oldest queued reply, if any. Returns its length and sets
+// *opcode. A pending CLOSE comes before anything else.
+static size_t ws_take_reply(ws_client_t *c, char *out, uint8_t *opcode, bool *closing) {
+  size_t len = 0;
+  *opcode = 0;
+  portENTER_CRITICAL(&ws_lock);
+  *closing = c->closing;
+  if (c->close_rx) {
+    len = c->close_len;
+    memcpy(out, c->close_payload, len);
+    *opcode = WS_OP_CLOSE;
+  } else if (c->reply_count) {
+    len = c->reply_len[c->reply_head];
+    memcpy(out, c->replies[c->reply_head], len);
+    *opcode = c->reply_op[c->reply_head];
+    c->reply_head = (c->reply_head + 1) % WS_REPLIES;
+    c->reply_count--;
+  }
+  portEXIT_CRITICAL(&ws_lock);
+  return len;
+}
+
+static void ws_task(void *arg) {
+  ws_client_t *c = (ws_client_t *)arg;
+  int fd = c->fd;
+  httpd_handle_t hd = c->hd;
+  char reply[WS_REPLY_MAX];
+  bool ok = true;
+
+  int nodelay = 1;
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+
+  while (ok) {
+    bool closing;
+    uint8_t opcode;
+    size_t reply_len = ws_take_reply(c, reply, &opcode, &closing);
+    if (closing) {
+      break;
+    }
+    if (opcode == WS_OP_CLOSE) {
+      ws_send(fd, WS_OP_CLOSE, reply, reply_len, NULL, 0);
+      break;  // closing handshake answered; end the session
+    }
+    if (opcode) {
+      ok = ws_send(fd, opcode, reply, reply_len, NULL, 0);
+      continue;
+    }
+
+    frame_t *frame = frame_hub_wait(c->sub, pdMS_TO_TICKS(WS_FRAME_WAIT_MS));
+    if (!frame) {
+      continue;
+    }
+    if (!stream_rate_should_send(&c->rate)) {
+      metrics_frame_skipped();
+      frame_release(frame);
+      continue;
+    }
+
+    ws_frame_meta_t meta;
+    meta.seq = frame->seq;
+    meta.len = frame->len;
+    meta.timestamp_us = (int64_t)frame->timestamp.tv_sec * 1000000 + frame->timestamp.tv_usec;
+    clock_sync_t cs = clock_sync_snapshot();
+    meta.phone_us = cs.valid ? clock_sync_to_phone_us(&cs, meta.timestamp_us) : 0;
+    meta.quality = (uint8_t)frame->quality;
+    meta.skip = stream_rate_skip(&c->rate);
+    meta.reserved = 0;
+
+    int64_t send_start = esp_timer_get_time();
+    ok = ws_send(fd, WS_OP_BINARY, &meta, sizeof(meta), frame->buf, frame->len);
+    if (ok) {
+      int64_t sent_us = esp_timer_get_time();
+      stream_rate_sample(&c->rate, (uint32_t)(sent_us - send_start));
+      stream_record_sent(frame, send_start, sent_us);
+    } else {
+      log_e("WS send frame failed");
+    }
+    frame_release(frame);
+  }
+
+  stream_rate_close(&c->rate);
+  frame_hub_unsubscribe(c->sub);
 #if defined(LED_GPIO_NUM)
-  else if (!strcmp(variable, "led_intensity")) {
-    led_duty = val;
-    if (isStreaming) {
-      enable_led(true);
+  stream_led_update(-1);
+#endif
+
+  portENTER_CRITICAL(&ws_lock);
+  bool closing = c->closing;
+  c->in_use = false;
+  portEXIT_CRITICAL(&ws_lock);
+
+  if (closing) {
+    close(fd);
+  } else {
+    httpd_sess_trigger_close(hd, fd);
+  }
+  vTaskDelete(NULL);
+}
+
+// Handshake done: claim a client slot and start its sender.
+static esp_err_t ws_open(httpd_req_t *req) {
+  frame_sub_t *sub = frame_hub_subscribe();
+  if (!sub) {
+    return ESP_FAIL;
+  }
+
+  int fd = httpd_req_to_sockfd(req);
+  ws_client_t *c = NULL;
+  portENTER_CRITICAL(&ws_lock);
+  for (int i = 0; i < WS_MAX_CLIENTS; i++) {
+    if (!ws_clients[i].in_use) {
+      c = &ws_clients[i];
+      c->in_use = true;
+      c->closing = false;
+      c->fd = fd;
+      c->hd = req->handle;
+      c->sub = sub;
+      c->reply_head = 0;
+      c->reply_count = 0;
+      c->close_rx = false;
+      break;
     }
   }
+  portEXIT_CRITICAL(&ws_lock);
+  if (!c) {
+    frame_hub_unsubscribe(sub);
+    return ESP_FAIL;
+  }
+  stream_rate_open(&c->rate, STREAM_RATE_TARGET_US);
+
+#if defined(LED_GPIO_NUM)
+  stream_led_update(1);
 #endif
-  else {
-    log_i("Unknown command: %s", variable);
-    res = -1;
+
+  if (xTaskCreatePinnedToCore(ws_task, "ws_stream", STREAM_TASK_STACK, c, STREAM_TASK_PRIORITY, NULL, FRAME_HUB_SEND_CORE) != pdPASS) {
+#if defined(LED_GPIO_NUM)
+    stream_led_update(-1);
+#endif
+    stream_rate_close(&c->rate);
+    frame_hub_unsubscribe(sub);
+    portENTER_CRITICAL(&ws_lock);
+    c->in_use = false;
+    portEXIT_CRITICAL(&ws_lock);
+    return ESP_FAIL;
+  }
+  return ESP_OK;
+}
+
+static esp_err_t ws_handler(httpd_req_t *req) {
+  if (req->method == HTTP_GET) {
+    return ws_open(req);
   }
 
-  if (res < 0) {
-    return httpd_resp_send_500(req);
+  char msg[WS_MSG_MAX];
+  httpd_ws_frame_t pkt;
+  memset(&pkt, 0, sizeof(pkt));
+  esp_err_t ret = httpd_ws_recv_frame(req, &pkt, 0);
+  if (ret != ESP_OK) {
+    return ret;
+  }
+  if (pkt.len >= sizeof(msg)) {
+    return ESP_FAIL;  // can't skip an unread payload; drop the client
+  }
+  pkt.payload = (uint8_t *)msg;
+  ret = httpd_ws_recv_frame(req, &pkt, sizeof(msg) - 1);
+  if (ret != ESP_OK) {
+    return ret;
   }
+  int fd = httpd_req_to_sockfd(req);
+  if (pkt.type == HTTPD_WS_TYPE_PING) {
+    ws_queue(fd, WS_OP_PONG, msg, pkt.len);
+    return ESP_OK;
+  }
+  if (pkt.type == HTTPD_WS_TYPE_CLOSE) {
+    ws_queue_close(fd, (const uint8_t *)msg, pkt.len);
+    return ESP_OK;
+  }
+  if (pkt.type != HTTPD_WS_TYPE_TEXT) {
+    return ESP_OK;  // PONGs and binary messages aren't used
+  }
+  msg[pkt.len] = 0;
 
-  httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
-  return httpd_resp_send(req, NULL, 0);
+  char variable[32];
+  char value[32];
+  if (httpd_query_key_value(msg, "var", variable, sizeof(variable)) != ESP_OK || httpd_query_key_value(msg, "val", value, sizeof(value)) != ESP_OK) {
+    ws_queue_reply(fd, "", -1);
+    return ESP_OK;
+  }
+  ws_queue_reply(fd, variable, set_control(variable, atoi(value)));
+  return ESP_OK;
 }
 
-static int print_reg(char *p, sensor_t *s, uint16_t reg, uint32_t mask) {
-  return sprintf(p, "\"0x%x\":%u,", reg, s->get_reg(s, reg, mask));
+// Sessions still owned by a /ws sender are closed by the sender, so the fd
+// can't be reused under it.
+static void stream_close_fn(httpd_handle_t hd, int fd) {
+  portENTER_CRITICAL(&ws_lock);
+  ws_client_t *c = ws_find(fd);
+  if (c) {
+    c->closing = true;
+  }
+  portEXIT_CRITICAL(&ws_lock);
+  if (!c) {
+    close(fd);
+  }
 }
+#endif
 
-static esp_err_t status_handler(httpd_req_t *req) {
-  static char json_response[1024];
+// /status is polled, so the reply is cached and only rebuilt after
+// something it reports changes. The sensor registers it includes are kept
+// in a shadow and read over SCCB only after a write that may have touched
+// them (regs_changes). Values the sensor moves on its own under auto
+// exposure and gain stay as last read until the next such write.
+#define STATUS_REGS_MAX 64
 
-  sensor_t *s = esp_camera_sensor_get();
-  char *p = json_response;
-  *p++ = '{';
+typedef struct {
+  uint16_t reg;
+  uint32_t mask;
+  int value;
+} reg_shadow_t;
+
+static reg_shadow_t status_regs[STATUS_REGS_MAX];
+static int status_reg_count = 0;
+static uint32_t status_regs_for = 0;
+
+static char status_json[1024];
+static size_t status_len = 0;
+static uint32_t status_built_for = 0;
+static char status_etag[12];
+
+static void shadow_reg(sensor_t *s, uint16_t reg, uint32_t mask) {
+  if (status_reg_count < STATUS_REGS_MAX) {
+    status_regs[status_reg_count++] = {reg, mask, s->get_reg(s, reg, mask)};
+  }
+}
 
+static void status_read_regs(sensor_t *s) {
+  status_reg_count = 0;
   if (s->id.PID == OV5640_PID || s->id.PID == OV3660_PID) {
     for (int reg = 0x3400; reg < 0x3406; reg += 2) {
-      p += print_reg(p, s, reg, 0xFFF);  //12 bit
+      shadow_reg(s, reg, 0xFFF);  //12 bit
     }
-    p += print_reg(p, s, 0x3406, 0xFF);
+    shadow_reg(s, 0x3406, 0xFF);
 
-    p += print_reg(p, s, 0x3500, 0xFFFF0);  //16 bit
-    p += print_reg(p, s, 0x3503, 0xFF);
-    p += print_reg(p, s, 0x350a, 0x3FF);   //10 bit
-    p += print_reg(p, s, 0x350c, 0xFFFF);  //16 bit
+    shadow_reg(s, 0x3500, 0xFFFF0);  //16 bit
+    shadow_reg(s, 0x3503, 0xFF);
+    shadow_reg(s, 0x350a, 0x3FF);   //10 bit
+    shadow_reg(s, 0x350c, 0xFFFF);  //16 bit
 
     for (int reg = 0x5480; reg <= 0x5490; reg++) {
-      p += print_reg(p, s, reg, 0xFF);
+      shadow_reg(s, reg, 0xFF);
     }
 
     for (int reg = 0x5380; reg <= 0x538b; reg++) {
-      p += print_reg(p, s, reg, 0xFF);
+      shadow_reg(s, reg, 0xFF);
     }
 
     for (int reg = 0x5580; reg < 0x558a; reg++) {
-      p += print_reg(p, s, reg, 0xFF);
+      shadow_reg(s, reg, 0xFF);
     }
-    p += print_reg(p, s, 0x558a, 0x1FF);  //9 bit
+    shadow_reg(s, 0x558a, 0x1FF);  //9 bit
   } else if (s->id.PID == OV2640_PID) {
-    p += print_reg(p, s, 0xd3, 0xFF);
-    p += print_reg(p, s, 0x111, 0xFF);
-    p += print_reg(p, s, 0x132, 0xFF);
+    shadow_reg(s, 0xd3, 0xFF);
+    shadow_reg(s, 0x111, 0xFF);
+    shadow_reg(s, 0x132, 0xFF);
+  }
+}
+
+static size_t status_build(char *json_response, sensor_t *s) {
+  char *p = json_response;
+  *p++ = '{';
+
+  for (int i = 0; i < status_reg_count; i++) {
+    p += sprintf(p, "\"0x%x\":%u,", status_regs[i].reg, status_regs[i].value);
   }
 
   p += sprintf(p, "\"xclk\":%u,", s->xclk_freq_hz / 1000000);
@@ -483,10 +1263,133 @@ static esp_err_t status_handler(httpd_req_t *req) {
   p += sprintf(p, ",\"led_intensity\":%d", -1);
 #endif
   *p++ = '}';
-  *p++ = 0;
+  *p = 0;
+  return p - json_response;
+}
+
+static uint32_t status_hash(const char *data, size_t len) {
+  uint32_t h = 2166136261u;
+  while (len--) {
+    h = (h ^ (uint8_t)*data++) * 16777619u;
+  }
+  return h;
+}
+
+static esp_err_t status_handler(httpd_req_t *req) {
+  sensor_t *s = esp_camera_sensor_get();
+
+  uint32_t regs_now = __atomic_load_n(&regs_changes, __ATOMIC_ACQUIRE);
+  if (regs_now != status_regs_for) {
+    status_read_regs(s);
+    status_regs_for = regs_now;
+    status_built_for = 0;  // force a rebuild below
+  }
+  uint32_t changes_now = __atomic_load_n(&status_changes, __ATOMIC_ACQUIRE);
+  if (changes_now != status_built_for) {
+    status_len = status_build(status_json, s);
+    status_built_for = changes_now;
+    // Content-based, so a rebuild that comes out the same keeps its tag.
+    snprintf(status_etag, sizeof(status_etag), "\"%08x\"", (unsigned)status_hash(status_json, status_len));
+  }
+
+  httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
+  httpd_resp_set_hdr(req, "Cache-Control", "no-cache");
+  httpd_resp_set_hdr(req, "ETag", status_etag);
+
+  char inm[16];
+  if (httpd_req_get_hdr_value_str(req, "If-None-Match", inm, sizeof(inm)) == ESP_OK && !strcmp(inm, status_etag)) {
+    httpd_resp_set_status(req, "304 Not Modified");
+    return httpd_resp_send(req, NULL, 0);
+  }
+  httpd_resp_set_type(req, "application/json");
+  return httpd_resp_send(req, status_json, status_len);
+}
+
+static bool parse_get_int64(char *buf, const char *key, int64_t *out) {
+  char _int[24];
+  if (httpd_query_key_value(buf, key, _int, sizeof(_int)) != ESP_OK) {
+    return false;
+  }
+  *out = strtoll(_int, NULL, 10);
+  return true;
+}
+
+// GET /time?t0=<phone us>[&off=<us>&rtt=<us>&at=<our t1 of that exchange>]
+static esp_err_t time_handler(httpd_req_t *req) {
+  int64_t t1 = esp_timer_get_time();
+  char *buf = NULL;
+  int64_t t0 = 0, off = 0, rtt = 0, at = 0;
+
+  if (parse_get(req, &buf) != ESP_OK) {
+    return ESP_FAIL;
+  }
+  parse_get_int64(buf, "t0", &t0);
+  if (parse_get_int64(buf, "off", &off) && parse_get_int64(buf, "rtt", &rtt) && parse_get_int64(buf, "at", &at)) {
+    clock_sync_submit(at, off, rtt);
+  }
+  free(buf);
+  clock_sync_t cs = clock_sync_snapshot();
+
+  char json_response[256];
+  int len = snprintf(
+    json_response, sizeof(json_response),
+    "{\"t0\":%lld,\"t1\":%lld,\"synced\":%s,\"offsetUs\":%lld,\"skewPpm\":%.2f,\"samples\":%u,\"rejected\":%u,\"t2\":%lld}", t0, t1,
+    cs.valid ? "true" : "false", cs.offset_us, cs.skew_ppm, (unsigned)cs.samples, (unsigned)cs.rejected,
+    esp_timer_get_time()
+  );
   httpd_resp_set_type(req, "application/json");
   httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
-  return httpd_resp_send(req, json_response, strlen(json_response));
+  return httpd_resp_send(req, json_response, len);
+}
+
+static esp_err_t metrics_handler(httpd_req_t *req) {
+  static char json_response[1024];
+  metric_hist_t hists[METRIC_STAGES];
+  metric_counters_t counters;
+  metrics_snapshot(hists, &counters);
+  frame_hub_stats_t hub = frame_hub_get_stats();
+  frame_pool_stats_t pool = frame_pool_get_stats();
+
+  char *p = json_response;
+  char *end = json_response + sizeof(json_response);
+  p += snprintf(
+    p, end - p,
+    "{\"uptimeMs\":%lld,\"clients\":%u,\"lastSeq\":%u,"
+    "\"frames\":{\"captured\":%u,\"sent\":%u,\"dropped\":%u,\"skipped\":%u,\"captureErrors\":%u,\"fbStarved\":%u,\"socketWrites\":%u},"
+    "\"pool\":{\"hits\":%u,\"misses\":%u,\"grows\":%u,\"trims\":%u,\"bytes\":%u},\"stagesUs\":{",
+    esp_timer_get_time() / 1000, (unsigned)hub.subscribers, (unsigned)counters.last_seq, (unsigned)hub.captured, (unsigned)counters.sent,
+    (unsigned)hub.dropped, (unsigned)counters.skipped, (unsigned)hub.capture_errors, (unsigned)counters.fb_starved, (unsigned)counters.socket_writes, (unsigned)pool.hits,
+    (unsigned)pool.misses, (unsigned)pool.grows, (unsigned)pool.trims, (unsigned)pool.bytes
+  );
+  for (int i = 0; i < METRIC_STAGES && p < end; i++) {
+    const metric_hist_t *h = &hists[i];
+    p += snprintf(
+      p, end - p, "%s\"%s\":{\"count\":%u,\"avg\":%d,\"p50\":%d,\"p90\":%d,\"p99\":%d,\"max\":%u}", i ? "," : "",
+      metrics_stage_name((metric_stage_t)i), (unsigned)h->count, h->count ? (int)(h->sum_us / h->count) : -1, (int)metrics_percentile(h, 0.5f),
+      (int)metrics_percentile(h, 0.9f), (int)metrics_percentile(h, 0.99f), (unsigned)h->max_us
+    );
+  }
+  // Cumulative time each pipeline stage has spent working, and the clock
+  // it was read at. A client takes two reads and divides the busy deltas
+  // by the atUs delta; send is summed over clients, so it can pass 100%.
+  // cores is the [capture, encode, send] placement the numbers came from.
+  if (p < end) {
+    p += snprintf(
+      p, end - p,
+      "},\"pipeline\":{\"atUs\":%lld,\"captureBusyUs\":%llu,\"encodeBusyUs\":%llu,\"sendBusyUs\":%llu,\"ringMax\":%u,\"ringStalls\":%u,"
+      "\"cores\":[%d,%d,%d]}}",
+      (long long)esp_timer_get_time(), (unsigned long long)hub.capture_busy_us, (unsigned long long)hub.encode_busy_us,
+      (unsigned long long)counters.send_busy_us, (unsigned)hub.ring_max, (unsigned)hub.ring_stalls, FRAME_HUB_CAPTURE_CORE,
+      FRAME_HUB_ENCODE_CORE, FRAME_HUB_SEND_CORE
+    );
+  }
+  if (p >= end) {
+    return httpd_resp_send_500(req);
+  }
+
+  httpd_resp_set_type(req, "application/json");
+  httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
+  return httpd_resp_send(req, json_response, p - json_response);
 }
 
 static esp_err_t xclk_handler(httpd_req_t *req) {
@@ -508,6 +1411,7 @@ static esp_err_t xclk_handler(httpd_req_t *req) {
 
   sensor_t *s = esp_camera_sensor_get();
   int res = s->set_xclk(s, LEDC_TIMER_0, xclk);
+  status_invalidate(true);
   if (res) {
     return httpd_resp_send_500(req);
   }
@@ -540,6 +1444,7 @@ static esp_err_t reg_handler(httpd_req_t *req) {
 
   sensor_t *s = esp_camera_sensor_get();
   int res = s->set_reg(s, reg, mask, val);
+  status_invalidate(true);
   if (res) {
     return httpd_resp_send_500(req);
   }
@@ -578,6 +1483,69 @@ static esp_err_t greg_handler(httpd_req_t *req) {
   return httpd_resp_send(req, val, strlen(val));
 }
 
+// Many registers in one request, run back to back:
+//   /regs?set=<reg>:<mask>:<val>,...&get=<reg>[:<mask>],...
+// Numbers may be decimal or 0x hex. Writes go first, then reads. Replies
+// {"set":[<res>,...],"get":[[<reg>,<val>],...]}, with -1 for a failed read.
+#define REGS_MAX       32
+#define REGS_LIST_LEN  512
+
+static esp_err_t regs_handler(httpd_req_t *req) {
+  char *buf = NULL;
+  static char list[REGS_LIST_LEN];
+  static char json_response[1024];
+
+  if (parse_get(req, &buf) != ESP_OK) {
+    return ESP_FAIL;
+  }
+
+  sensor_t *s = esp_camera_sensor_get();
+  size_t len = 0;
+  bool fits = buf_appendf(json_response, sizeof(json_response), &len, "{\"set\":[");
+  bool failed = false;
+  int n;
+
+  if (httpd_query_key_value(buf, "set", list, sizeof(list)) == ESP_OK) {
+    char *item = list;
+    for (n = 0; n < REGS_MAX && *item; n++) {
+      char *next;
+      int reg = strtol(item, &next, 0);
+      int mask = *next == ':' ? strtol(next + 1, &next, 0) : -1;
+      int val = *next == ':' ? strtol(next + 1, &next, 0) : -1;
+      int res = (mask < 0 || val < 0) ? -1 : s->set_reg(s, reg, mask, val);
+      status_invalidate(true);
+      failed |= res != 0;
+      fits &= buf_appendf(json_response, sizeof(json_response), &len, "%s%d", n ? "," : "", res);
+      item = *next == ',' ? next + 1 : next + strlen(next);
+    }
+  }
+  fits &= buf_appendf(json_response, sizeof(json_response), &len, "],\"get\":[");
+  if (httpd_query_key_value(buf, "get", list, sizeof(list)) == ESP_OK) {
+    char *item = list;
+    for (n = 0; n < REGS_MAX && *item; n++) {
+      char *next;
+      int reg = strtol(item, &next, 0);
+      int mask = *next == ':' ? strtol(next + 1, &next, 0) : 0xFF;
+      int val = s->get_reg(s, reg, mask);
+      failed |= val < 0;
+      fits &= buf_appendf(json_response, sizeof(json_response), &len, "%s[%d,%d]", n ? "," : "", reg, val < 0 ? -1 : val);
+      item = *next == ',' ? next + 1 : next + strlen(next);
+    }
+  }
+  free(buf);
+  fits &= buf_appendf(json_response, sizeof(json_response), &len, "]}");
+  if (!fits) {
+    return httpd_resp_send_500(req);
+  }
+
+  if (failed) {
+    httpd_resp_set_status(req, "500 Internal Server Error");
+  }
+  httpd_resp_set_type(req, "application/json");
+  httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
+  return httpd_resp_send(req, json_response, len);
+}
+
 static int parse_get_var(char *buf, const char *key, int def) {
   char _int[16];
   if (httpd_query_key_value(buf, key, _int, sizeof(_int)) != ESP_OK) {
@@ -606,6 +1574,7 @@ static esp_err_t pll_handler(httpd_req_t *req) {
   log_i("Set Pll: bypass: %d, mul: %d, sys: %d, root: %d, pre: %d, seld5: %d, pclken: %d, pclk: %d", bypass, mul, sys, root, pre, seld5, pclken, pclk);
   sensor_t *s = esp_camera_sensor_get();
   int res = s->set_pll(s, bypass, mul, sys, root, pre, seld5, pclken, pclk);
+  status_invalidate(true);
   if (res) {
     return httpd_resp_send_500(req);
   }
@@ -641,6 +1610,7 @@ static esp_err_t win_handler(httpd_req_t *req) {
   );
   sensor_t *s = esp_camera_sensor_get();
   int res = s->set_res_raw(s, startX, startY, endX, endY, offsetX, offsetY, totalX, totalY, outputX, outputY, scale, binning);  // codespell:ignore totaly
+  status_invalidate(true);
   if (res) {
     return httpd_resp_send_500(req);
   }
@@ -678,7 +1648,7 @@ void startCameraServer() {
     .user_ctx = NULL
 #ifdef CONFIG_HTTPD_WS_SUPPORT
     ,
-    .is_websocket = true,
+    .is_websocket = false,
     .handle_ws_control_frames = false,
     .supported_subprotocol = NULL
 #endif
@@ -691,7 +1661,7 @@ void startCameraServer() {
     .user_ctx = NULL
 #ifdef CONFIG_HTTPD_WS_SUPPORT
     ,
-    .is_websocket = true,
+    .is_websocket = false,
     .handle_ws_control_frames = false,
     .supported_subprotocol = NULL
 #endif
@@ -704,7 +1674,7 @@ void startCameraServer() {
     .user_ctx = NULL
 #ifdef CONFIG_HTTPD_WS_SUPPORT
     ,
-    .is_websocket = true,
+    .is_websocket = false,
     .handle_ws_control_frames = false,
     .supported_subprotocol = NULL
 #endif
@@ -717,7 +1687,7 @@ void startCameraServer() {
     .user_ctx = NULL
 #ifdef CONFIG_HTTPD_WS_SUPPORT
     ,
-    .is_websocket = true,
+    .is_websocket = false,
     .handle_ws_control_frames = false,
     .supported_subprotocol = NULL
 #endif
@@ -730,7 +1700,7 @@ void startCameraServer() {
     .user_ctx = NULL
 #ifdef CONFIG_HTTPD_WS_SUPPORT
     ,
-    .is_websocket = true,
+    .is_websocket = false,
     .handle_ws_control_frames = false,
     .supported_subprotocol = NULL
 #endif
@@ -743,7 +1713,20 @@ void startCameraServer() {
     .user_ctx = NULL
 #ifdef CONFIG_HTTPD_WS_SUPPORT
     ,
-    .is_websocket = true,
+    .is_websocket = false,
+    .handle_ws_control_frames = false,
+    .supported_subprotocol = NULL
+#endif
+  };
+
+  httpd_uri_t raw_uri = {
+    .uri = "/raw",
+    .method = HTTP_GET,
+    .handler = raw_handler,
+    .user_ctx = NULL
+#ifdef CONFIG_HTTPD_WS_SUPPORT
+    ,
+    .is_websocket = false,
     .handle_ws_control_frames = false,
     .supported_subprotocol = NULL
 #endif
@@ -756,7 +1739,7 @@ void startCameraServer() {
     .user_ctx = NULL
 #ifdef CONFIG_HTTPD_WS_SUPPORT
     ,
-    .is_websocket = true,
+    .is_websocket = false,
     .handle_ws_control_frames = false,
     .supported_subprotocol = NULL
 #endif
@@ -769,7 +1752,7 @@ void startCameraServer() {
     .user_ctx = NULL
 #ifdef CONFIG_HTTPD_WS_SUPPORT
     ,
-    .is_websocket = true,
+    .is_websocket = false,
     .handle_ws_control_frames = false,
     .supported_subprotocol = NULL
 #endif
@@ -782,7 +1765,20 @@ void startCameraServer() {
     .user_ctx = NULL
 #ifdef CONFIG_HTTPD_WS_SUPPORT
     ,
-    .is_websocket = true,
+    .is_websocket = false,
+    .handle_ws_control_frames = false,
+    .supported_subprotocol = NULL
+#endif
+  };
+
+  httpd_uri_t regs_uri = {
+    .uri = "/regs",
+    .method = HTTP_GET,
+    .handler = regs_handler,
+    .user_ctx = NULL
+#ifdef CONFIG_HTTPD_WS_SUPPORT
+    ,
+    .is_websocket = false,
     .handle_ws_control_frames = false,
     .supported_subprotocol = NULL
 #endif
@@ -795,7 +1791,7 @@ void startCameraServer() {
     .user_ctx = NULL
 #ifdef CONFIG_HTTPD_WS_SUPPORT
     ,
-    .is_websocket = true,
+    .is_websocket = false,
     .handle_ws_control_frames = false,
     .supported_subprotocol = NULL
 #endif
@@ -808,13 +1804,54 @@ void startCameraServer() {
     .user_ctx = NULL
 #ifdef CONFIG_HTTPD_WS_SUPPORT
     ,
-    .is_websocket = true,
+    .is_websocket = false,
+    .handle_ws_control_frames = false,
+    .supported_subprotocol = NULL
+#endif
+  };
+
+  httpd_uri_t time_uri = {
+    .uri = "/time",
+    .method = HTTP_GET,
+    .handler = time_handler,
+    .user_ctx = NULL
+#ifdef CONFIG_HTTPD_WS_SUPPORT
+    ,
+    .is_websocket = false,
+    .handle_ws_control_frames = false,
+    .supported_subprotocol = NULL
+#endif
+  };
+
+  httpd_uri_t metrics_uri = {
+    .uri = "/metrics",
+    .method = HTTP_GET,
+    .handler = metrics_handler,
+    .user_ctx = NULL
+#ifdef CONFIG_HTTPD_WS_SUPPORT
+    ,
+    .is_websocket = false,
     .handle_ws_control_frames = false,
     .supported_subprotocol = NULL
 #endif
   };
 
-  ra_filter_init(&ra_filter, 20);
+#ifdef CONFIG_HTTPD_WS_SUPPORT
+  httpd_uri_t ws_uri = {
+    .uri = "/ws",
+    .method = HTTP_GET,
+    .handler = ws_handler,
+    .user_ctx = NULL,
+    .is_websocket = true,
+    .handle_ws_control_frames = true,  // answered by the sender, see ws_handler
+    .supported_subprotocol = NULL
+  };
+#endif
+
+  frame_hub_set_pre_capture(stream_apply_quality);
+  if (!frame_hub_start()) {
+    log_e("Frame hub failed to start");
+  }
 
   log_i("Starting web server on port: '%d'", config.server_port);
   if (httpd_start(&camera_httpd, &config) == ESP_OK) {
@@ -823,19 +1860,29 @@ void startCameraServer() {
     httpd_register_uri_handler(camera_httpd, &status_uri);
     httpd_register_uri_handler(camera_httpd, &capture_uri);
     httpd_register_uri_handler(camera_httpd, &bmp_uri);
+    httpd_register_uri_handler(camera_httpd, &raw_uri);
 
     httpd_register_uri_handler(camera_httpd, &xclk_uri);
     httpd_register_uri_handler(camera_httpd, &reg_uri);
     httpd_register_uri_handler(camera_httpd, &greg_uri);
+    httpd_register_uri_handler(camera_httpd, &regs_uri);
     httpd_register_uri_handler(camera_httpd, &pll_uri);
     httpd_register_uri_handler(camera_httpd, &win_uri);
+    httpd_register_uri_handler(camera_httpd, &time_uri);
+    httpd_register_uri_handler(camera_httpd, &metrics_uri);
   }
 
   config.server_port += 1;
   config.ctrl_port += 1;
+#ifdef CONFIG_HTTPD_WS_SUPPORT
+  config.close_fn = stream_close_fn;
+#endif
   log_i("Starting stream server on port: '%d'", config.server_port);
   if (httpd_start(&stream_httpd, &config) == ESP_OK) {
     httpd_register_uri_handler(stream_httpd, &stream_uri);
+#ifdef CONFIG_HTTPD_WS_SUPPORT
+    httpd_register_uri_handler(stream_httpd, &ws_uri);
+#endif
   }
 }
 
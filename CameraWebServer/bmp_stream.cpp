@@ -0,0 +1,209 @@
+#include "bmp_stream.h"
+#include "esp_jpg_decode.h"
+#include <stdlib.h>
+#include <string.h>
+
+static void put_le32(uint8_t *p, uint32_t v) {
+  p[0] = v;
+  p[1] = v >> 8;
+  p[2] = v >> 16;
+  p[3] = v >> 24;
+}
+
+// 24-bit top-down BMP, the layout frame2bmp produces. Rows are BGR.
+static void bmp_write_header(uint8_t *out, int width, int height) {
+  size_t data_len = (size_t)width * height * 3;
+  memset(out, 0, BMP_HEADER_LEN);
+  out[0] = 'B';
+  out[1] = 'M';
+  put_le32(out + 2, BMP_HEADER_LEN + data_len);
+  put_le32(out + 10, BMP_HEADER_LEN);
+  put_le32(out + 14, 40);
+  put_le32(out + 18, width);
+  put_le32(out + 22, (uint32_t)-height);
+  out[26] = 1;   // planes
+  out[28] = 24;  // bits per pixel
+  put_le32(out + 34, data_len);
+}
+
+static bool send_header(int width, int height, bmp_out_cb out, void *arg) {
+  uint8_t header[BMP_HEADER_LEN];
+  bmp_write_header(header, width, height);
+  return out(arg, header, sizeof(header));
+}
+
+size_t raw_bytes_per_pixel(pixformat_t format) {
+  switch (format) {
+    case PIXFORMAT_GRAYSCALE: return 1;
+    case PIXFORMAT_RGB565:
+    case PIXFORMAT_YUV422:    return 2;
+    case PIXFORMAT_RGB888:    return 3;
+    default:                  return 0;
+  }
+}
+
+size_t raw_rows_per_chunk(const camera_fb_t *fb) {
+  size_t row = fb->width * raw_bytes_per_pixel(fb->format);
+  if (row == 0) {
+    return 0;
+  }
+  size_t rows = BMP_CHUNK_BYTES / row;
+  return rows ? rows : 1;
+}
+
+static inline uint8_t clamp8(int v) {
+  return v < 0 ? 0 : (v > 255 ? 255 : v);
+}
+
+// One row of a raw frame as BGR888.
+static void row_to_bgr(const camera_fb_t *fb, size_t y, uint8_t *o) {
+  size_t w = fb->width;
+  const uint8_t *src = fb->buf + y * w * raw_bytes_per_pixel(fb->format);
+
+  switch (fb->format) {
+    case PIXFORMAT_GRAYSCALE:
+      for (size_t x = 0; x < w; x++, o += 3) {
+        o[0] = o[1] = o[2] = src[x];
+      }
+      break;
+    case PIXFORMAT_RGB565:
+      for (size_t x = 0; x < w; x++, o += 3, src += 2) {
+        uint16_t p = ((uint16_t)src[0] << 8) | src[1];  // sensor sends big-endian
+        o[0] = (p << 3) & 0xF8;
+        o[1] = (p >> 3) & 0xFC;
+        o[2] = (p >> 8) & 0xF8;
+      }
+      break;
+    case PIXFORMAT_YUV422:
+      // Y0 U Y1 V per pixel pair.
+      for (size_t x = 0; x + 1 < w; x += 2, src += 4) {
+        int u = src[1] - 128, v = src[3] - 128;
+        int dr = (359 * v) >> 8;
+        int dg = (88 * u + 183 * v) >> 8;
+        int db = (454 * u) >> 8;
+        for (int i = 0; i < 2; i++, o += 3) {
+          int yy = src[i * 2];
+          o[0] = clamp8(yy + db);
+          o[1] = clamp8(yy - dg);
+          o[2] = clamp8(yy + dr);
+        }
+      }
+      break;
+    case PIXFORMAT_RGB888:
+      memcpy(o, src, w * 3);  // as frame2bmp does
+      break;
+    default:
+      break;
+  }
+}
+
+static bool stream_raw(camera_fb_t *fb, bmp_out_cb out, void *arg) {
+  size_t rows = raw_rows_per_chunk(fb);
+  size_t row_len = fb->width * 3;
+  uint8_t *block = (uint8_t *)malloc(rows * row_len);
+  if (!block) {
+    return false;
+  }
+  bool ok = send_header(fb->width, fb->height, out, arg);
+  for (size_t y = 0; ok && y < fb->height; y += rows) {
+    size_t n = fb->height - y < rows ? fb->height - y : rows;
+    for (size_t i = 0; i < n; i++) {
+      row_to_bgr(fb, y + i, block + i * row_len);
+    }
+    ok = out(arg, block, n * row_len);
+  }
+  free(block);
+  return ok;
+}
+
+// JPEG frames: the decoder hands over MCU blocks left to right, top to
+// bottom, so collect one band of MCU rows and send it when the next band
+// starts.
+#define BMP_MCU_ROWS 16
+
+typedef struct {
+  camera_fb_t *fb;
+  bmp_out_cb out;
+  void *arg;
+  uint8_t *band;
+  size_t row_len;
+  uint16_t band_y;
+  uint16_t band_h;
+  bool failed;
+} jpg_band_t;
+
+static size_t jpg_read(void *arg, size_t index, uint8_t *buf, size_t len) {
+  jpg_band_t *j = (jpg_band_t *)arg;
+  if (index + len > j->fb->len) {
+    len = j->fb->len - index;
+  }
+  if (buf) {
+    memcpy(buf, j->fb->buf + index, len);
+  }
+  return len;
+}
+
+static bool jpg_flush(jpg_band_t *j) {
+  if (j->band_h && !j->failed) {
+    j->failed = !j->out(j->arg, j->band, j->band_h * j->row_len);
+  }
+  j->band_h = 0;
+  return !j->failed;
+}
+
+static bool jpg_write(void *arg, uint16_t x, uint16_t y, uint16_t w, uint16_t h, uint8_t *data) {
+  jpg_band_t *j = (jpg_band_t *)arg;
+  if (!data) {
+    if (x == 0 && y == 0) {
+      // Start: w and h are the image size.
+      j->row_len = (size_t)w * 3;
+      j->band = (uint8_t *)malloc(BMP_MCU_ROWS * j->row_len);
+      if (!j->band) {
+        return false;
+      }
+      j->failed = !send_header(w, h, j->out, j->arg);
+      return !j->failed;
+    }
+    return jpg_flush(j);  // end
+  }
+
+  if (y != j->band_y) {
+    if (!jpg_flush(j)) {
+      return false;
+    }
+    j->band_y = y;
+  }
+  if (h > BMP_MCU_ROWS) {
+    return false;
+  }
+  // The decoder gives RGB; BMP wants BGR.
+  for (uint16_t iy = 0; iy < h; iy++) {
+    uint8_t *o = j->band + iy * j->row_len + (size_t)x * 3;
+    for (uint16_t ix = 0; ix < w; ix++, o += 3, data += 3) {
+      o[0] = data[2];
+      o[1] = data[1];
+      o[2] = data[0];
+    }
+  }
+  if (h > j->band_h) {
+    j->band_h = h;
+  }
+  return true;
+}
+
+static bool stream_jpeg(camera_fb_t *fb, bmp_out_cb out, void *arg) {
+  jpg_band_t j = {fb, out, arg, NULL, 0, 0, 0, false};
+  esp_err_t err = esp_jpg_decode(fb->len, JPG_SCALE_NONE, jpg_read, jpg_write, &j);
+  free(j.band);
+  return err == ESP_OK && !j.failed;
+}
+
+bool bmp_stream(camera_fb_t *fb, bmp_out_cb out, void *arg) {
+  if (fb->format == PIXFORMAT_JPEG) {
+    return stream_jpeg(fb, out, arg);
+  }
+  if (raw_bytes_per_pixel(fb->format) == 0) {
+    return false;
+  }
+  return stream_raw(fb, out, arg);
+}
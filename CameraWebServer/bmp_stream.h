@@ -0,0 +1,24 @@
+#ifndef BMP_STREAM_H
+#define BMP_STREAM_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "esp_camera.h"
+
+// Frame to 24-bit BMP, handed out a block of rows at a time instead of
+// built in one buffer. Raw formats are converted a few KB at a time; JPEG
+// is decoded one MCU row (8 or 16 lines) at a time.
+#define BMP_HEADER_LEN   54
+#define BMP_CHUNK_BYTES  4096  // target size of a block of raw-format rows
+
+// Return false to stop.
+typedef bool (*bmp_out_cb)(void *arg, const uint8_t *data, size_t len);
+
+bool bmp_stream(camera_fb_t *fb, bmp_out_cb out, void *arg);
+
+// Rows per block when sending a raw frame as-is.
+size_t raw_rows_per_chunk(const camera_fb_t *fb);
+size_t raw_bytes_per_pixel(pixformat_t format);
+
+#endif  // BMP_STREAM_H
@@ -0,0 +1,86 @@
+#include "clock_sync.h"
+#include "freertos/FreeRTOS.h"
+
+#define CLOCK_SYNC_RTT_SLACK_US  2000     // accept up to 2x best RTT + slack
+#define CLOCK_SYNC_OFFSET_GAIN   0.25f
+#define CLOCK_SYNC_SKEW_GAIN     0.125f
+#define CLOCK_SYNC_MAX_SKEW_PPM  500.0f
+#define CLOCK_SYNC_MIN_SPAN_US   1000000  // need >= 1s between samples for skew
+
+static clock_sync_t clock_sync = {false, 0, 0, 0.0f, INT64_MAX, 0, 0};
+static portMUX_TYPE clock_sync_lock = portMUX_INITIALIZER_UNLOCKED;
+
+void clock_sync_init(clock_sync_t *cs) {
+  cs->valid = false;
+  cs->ref_local_us = 0;
+  cs->offset_us = 0;
+  cs->skew_ppm = 0.0f;
+  cs->min_rtt_us = INT64_MAX;
+  cs->samples = 0;
+  cs->rejected = 0;
+}
+
+int64_t clock_sync_to_phone_us(const clock_sync_t *cs, int64_t local_us) {
+  int64_t since = local_us - cs->ref_local_us;
+  return local_us + cs->offset_us + (int64_t)(since * (cs->skew_ppm * 1e-6f));
+}
+
+bool clock_sync_update(clock_sync_t *cs, int64_t at_local_us, int64_t offset_us, int64_t rtt_us) {
+  if (rtt_us < 0) {
+    cs->rejected++;
+    return false;
+  }
+
+  if (rtt_us < cs->min_rtt_us) {
+    cs->min_rtt_us = rtt_us;
+  } else {
+    cs->min_rtt_us += (rtt_us - cs->min_rtt_us) / 32;
+  }
+
+  // Well above the best round trip means one leg sat in a queue, which
+  // biases the offset by up to half the excess.
+  if (cs->valid && rtt_us > 2 * cs->min_rtt_us + CLOCK_SYNC_RTT_SLACK_US) {
+    cs->rejected++;
+    return false;
+  }
+
+  cs->samples++;
+  if (!cs->valid) {
+    cs->ref_local_us = at_local_us;
+    cs->offset_us = offset_us;
+    cs->skew_ppm = 0.0f;
+    cs->valid = true;
+    return true;
+  }
+
+  int64_t span = at_local_us - cs->ref_local_us;
+  int64_t predicted = clock_sync_to_phone_us(cs, at_local_us) - at_local_us;
+  int64_t err = offset_us - predicted;
+
+  if (span >= CLOCK_SYNC_MIN_SPAN_US) {
+    float ppm = cs->skew_ppm + CLOCK_SYNC_SKEW_GAIN * ((float)err * 1e6f / (float)span);
+    if (ppm > CLOCK_SYNC_MAX_SKEW_PPM) {
+      ppm = CLOCK_SYNC_MAX_SKEW_PPM;
+    } else if (ppm < -CLOCK_SYNC_MAX_SKEW_PPM) {
+      ppm = -CLOCK_SYNC_MAX_SKEW_PPM;
+    }
+    cs->skew_ppm = ppm;
+  }
+  cs->offset_us = predicted + (int64_t)(err * CLOCK_SYNC_OFFSET_GAIN);
+  cs->ref_local_us = at_local_us;
+  return true;
+}
+
+bool clock_sync_submit(int64_t at_local_us, int64_t offset_us, int64_t rtt_us) {
+  portENTER_CRITICAL(&clock_sync_lock);
+  bool ok = clock_sync_update(&clock_sync, at_local_us, offset_us, rtt_us);
+  portEXIT_CRITICAL(&clock_sync_lock);
+  return ok;
+}
+
+clock_sync_t clock_sync_snapshot(void) {
+  portENTER_CRITICAL(&clock_sync_lock);
+  clock_sync_t cs = clock_sync;
+  portEXIT_CRITICAL(&clock_sync_lock);
+  return cs;
+}
@@ -0,0 +1,32 @@
+#ifndef CLOCK_SYNC_H
+#define CLOCK_SYNC_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// NTP-style offset/skew estimate of the phone's clock against esp_timer.
+//
+// The phone calls GET /time?t0=<phone us> and gets back our receive (t1)
+// and transmit (t2) times. It computes offset and round trip from
+// t0..t3 and passes them back on its next call (off=, rtt=, at=<that t1>).
+typedef struct {
+  bool valid;
+  int64_t ref_local_us;  // esp_timer time the estimate is anchored at
+  int64_t offset_us;     // phone - local at ref_local_us
+  float skew_ppm;        // phone clock rate relative to ours
+  int64_t min_rtt_us;    // best recent round trip, for outlier rejection
+  uint32_t samples;
+  uint32_t rejected;
+} clock_sync_t;
+
+void clock_sync_init(clock_sync_t *cs);
+bool clock_sync_update(clock_sync_t *cs, int64_t at_local_us, int64_t offset_us, int64_t rtt_us);
+int64_t clock_sync_to_phone_us(const clock_sync_t *cs, int64_t local_us);
+
+// The shared estimate. /time updates it while the stream senders read it
+// from their own tasks, so it's only reached through a lock: submit a
+// sample, or take a consistent copy to convert timestamps with.
+bool clock_sync_submit(int64_t at_local_us, int64_t offset_us, int64_t rtt_us);
+clock_sync_t clock_sync_snapshot(void);
+
+#endif  // CLOCK_SYNC_H
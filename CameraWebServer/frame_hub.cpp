@@ -0,0 +1,382 @@
+#include "frame_hub.h"
+#include "frame_pool.h"
+#include "stream_metrics.h"
+#include "esp_timer.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "esp_camera.h"
+#include "img_converters.h"
+#include <string.h>
+
+#if defined(ARDUINO_ARCH_ESP32) && defined(CONFIG_ARDUHAL_ESP_LOG)
+#include "esp32-hal-log.h"
+#endif
+
+#define FRAME_HUB_TASK_STACK    4096
+#define FRAME_HUB_TASK_PRIORITY 5
+#define FRAME_HUB_RING          4  // power of two; fb_count bounds it in practice
+#define FRAME_HUB_RING_WAIT_MS  50
+#define FRAME_HUB_JPEG_QUALITY  80  // only used if the sensor isn't in JPEG mode
+#define FRAME_HUB_ENCODE_START  4   // first guess at JPEG size: pixels / 4
+
+struct frame_sub_s {
+  bool in_use;
+  frame_t *pending;  // newest frame not yet taken, or NULL
+  uint32_t dropped;
+  SemaphoreHandle_t ready;
+};
+
+static portMUX_TYPE hub_lock = portMUX_INITIALIZER_UNLOCKED;
+static frame_sub_t subs[FRAME_HUB_MAX_SUBS];
+static TaskHandle_t capture_task = NULL;
+static TaskHandle_t encode_task = NULL;
+static bool hub_running = false;  // both tasks up; set once by frame_hub_start
+static frame_hub_hook_t pre_capture = NULL;
+static frame_hub_stats_t hub_stats = {};
+
+// Expected encoder output size for non-JPEG formats; doubled whenever a
+// frame doesn't fit.
+static size_t encode_cap = 0;
+
+static void frame_free(frame_t *frame) {
+  frame_pool_put(frame->buf);
+  free(frame);
+}
+
+void frame_release(frame_t *frame) {
+  if (!frame) {
+    return;
+  }
+  portENTER_CRITICAL(&hub_lock);
+  bool last = (--frame->refs == 0);
+  portEXIT_CRITICAL(&hub_lock);
+  if (last) {
+    frame_free(frame);
+  }
+}
+
+typedef struct {
+  uint8_t *buf;
+  size_t cap;
+  size_t len;
+  bool overflow;
+} encode_out_t;
+
+// The encoder ignores a short write and still reports success, so an
+// overflow is only seen through out->overflow; once set, nothing more is
+// appended.
+static size_t encode_write(void *arg, size_t index, const void *data, size_t len) {
+  encode_out_t *out = (encode_out_t *)arg;
+  if (out->overflow || out->len + len > out->cap) {
+    out->overflow = true;
+    return 0;
+  }
+  memcpy(out->buf + out->len, data, len);
+  out->len += len;
+  return len;
+}
+
+// Encode a raw frame straight into a pool buffer.
+static bool encode_frame(camera_fb_t *fb, frame_t *frame) {
+  size_t pixels = (size_t)fb->width * fb->height;
+  if (encode_cap == 0) {
+    encode_cap = pixels / FRAME_HUB_ENCODE_START;
+  }
+  encode_out_t out = {NULL, 0, 0, false};
+  out.buf = frame_pool_get(encode_cap, &out.cap);
+  if (!out.buf) {
+    return false;
+  }
+  bool ok = frame2jpg_cb(fb, FRAME_HUB_JPEG_QUALITY, encode_write, &out);
+  if (!ok || out.overflow) {
+    if (out.overflow && encode_cap < pixels * 2) {
+      encode_cap *= 2;  // this frame is lost; the next one fits
+    }
+    frame_pool_put(out.buf);
+    return false;
+  }
+  frame->buf = out.buf;
+  frame->len = out.len;
+  return true;
+}
+
+// Capture and encode run as separate tasks on their own cores, joined by
+// a single-producer/single-consumer ring of camera buffers, so fetching
+// the next frame overlaps copying or encoding the last one. Only the
+// capture task moves ring_head and only the encode task moves ring_tail.
+typedef struct {
+  camera_fb_t *fb;
+  int64_t got_us;
+  int quality;  // sensor JPEG quality when fb was captured
+} ring_slot_t;
+
+static ring_slot_t ring[FRAME_HUB_RING];
+static uint32_t ring_head = 0;
+static uint32_t ring_tail = 0;
+
+static bool ring_push(const ring_slot_t *slot) {
+  uint32_t head = ring_head;
+  uint32_t used = head - __atomic_load_n(&ring_tail, __ATOMIC_ACQUIRE);
+  if (used == FRAME_HUB_RING) {
+    return false;
+  }
+  ring[head % FRAME_HUB_RING] = *slot;
+  __atomic_store_n(&ring_head, head + 1, __ATOMIC_RELEASE);
+  portENTER_CRITICAL(&hub_lock);
+  if (used + 1 > hub_stats.ring_max) {
+    hub_stats.ring_max = used + 1;
+  }
+  portEXIT_CRITICAL(&hub_lock);
+  return true;
+}
+
+static bool ring_pop(ring_slot_t *out) {
+  uint32_t tail = ring_tail;
+  if (__atomic_load_n(&ring_head, __ATOMIC_ACQUIRE) == tail) {
+    return false;
+  }
+  *out = ring[tail % FRAME_HUB_RING];
+  __atomic_store_n(&ring_tail, tail + 1, __ATOMIC_RELEASE);
+  return true;
+}
+
+// Copy or encode a camera buffer into a frame, then give the buffer back.
+static frame_t *frame_from_fb(const ring_slot_t *slot) {
+  camera_fb_t *fb = slot->fb;
+  int64_t got_us = slot->got_us;
+  frame_t *frame = (frame_t *)calloc(1, sizeof(frame_t));
+  if (frame) {
+    frame->timestamp = fb->timestamp;
+    frame->got_us = got_us;
+    frame->quality = slot->quality;
+    if (fb->format == PIXFORMAT_JPEG) {
+      size_t cap;
+      frame->buf = frame_pool_get(fb->len, &cap);
+      if (frame->buf) {
+        memcpy(frame->buf, fb->buf, fb->len);
+        frame->len = fb->len;
+      }
+    } else {
+      encode_frame(fb, frame);
+    }
+  }
+  esp_camera_fb_return(fb);
+
+  if (frame && !frame->buf) {
+    free(frame);
+    frame = NULL;
+  }
+  if (frame) {
+    frame->ready_us = esp_timer_get_time();
+    metrics_record(METRIC_ENCODE, frame->ready_us - got_us);
+  }
+  return frame;
+}
+
+// Hand the frame to every subscriber, replacing any frame they haven't
+// taken yet (drop-if-behind).
+static void publish(frame_t *frame) {
+  frame_t *replaced[FRAME_HUB_MAX_SUBS];
+  SemaphoreHandle_t wake[FRAME_HUB_MAX_SUBS];
+  int n_replaced = 0, n_wake = 0;
+
+  portENTER_CRITICAL(&hub_lock);
+  for (int i = 0; i < FRAME_HUB_MAX_SUBS; i++) {
+    frame_sub_t *s = &subs[i];
+    if (!s->in_use) {
+      continue;
+    }
+    if (s->pending) {
+      replaced[n_replaced++] = s->pending;
+      s->dropped++;
+      hub_stats.dropped++;
+    }
+    frame->refs++;
+    s->pending = frame;
+    wake[n_wake++] = s->ready;
+  }
+  portEXIT_CRITICAL(&hub_lock);
+
+  for (int i = 0; i < n_replaced; i++) {
+    frame_release(replaced[i]);
+  }
+  for (int i = 0; i < n_wake; i++) {
+    xSemaphoreGive(wake[i]);
+  }
+}
+
+static void capture_task_fn(void *arg) {
+  while (true) {
+    if (hub_stats.subscribers == 0) {
+      ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+      continue;
+    }
+
+    if (pre_capture) {
+      pre_capture();
+    }
+    // Read here, on the task that changes it between captures, so the
+    // encode task can't label a frame with a later setting.
+    sensor_t *s = esp_camera_sensor_get();
+    int quality = s ? s->status.quality : 0;
+    int64_t start_us = esp_timer_get_time();
+    camera_fb_t *fb = esp_camera_fb_get();
+    int64_t got_us = esp_timer_get_time();
+    portENTER_CRITICAL(&hub_lock);
+    hub_stats.capture_busy_us += got_us - start_us;
+    if (!fb) {
+      hub_stats.capture_errors++;
+    }
+    portEXIT_CRITICAL(&hub_lock);
+    if (!fb) {
+      metrics_fb_starved();
+      log_e("Camera capture failed");
+      vTaskDelay(pdMS_TO_TICKS(10));
+      continue;
+    }
+    int64_t sensor_us = (int64_t)fb->timestamp.tv_sec * 1000000 + fb->timestamp.tv_usec;
+    metrics_record(METRIC_CAPTURE, got_us - sensor_us);
+
+    // Encode is behind; wait for it to free a slot. It notifies us as it
+    // takes each buffer.
+    ring_slot_t slot = {fb, got_us, quality};
+    while (!ring_push(&slot)) {
+      portENTER_CRITICAL(&hub_lock);
+      hub_stats.ring_stalls++;
+      portEXIT_CRITICAL(&hub_lock);
+      ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(FRAME_HUB_RING_WAIT_MS));
+    }
+    xTaskNotifyGive(encode_task);
+  }
+}
+
+static void encode_task_fn(void *arg) {
+  uint32_t seq = 0;
+  ring_slot_t slot;
+  while (true) {
+    if (!ring_pop(&slot)) {
+      ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+      continue;
+    }
+    xTaskNotifyGive(capture_task);  // a ring slot just freed up
+
+    int64_t start_us = esp_timer_get_time();
+    frame_t *frame = frame_from_fb(&slot);
+    int64_t busy_us = esp_timer_get_time() - start_us;
+    portENTER_CRITICAL(&hub_lock);
+    hub_stats.encode_busy_us += busy_us;
+    if (frame) {
+      hub_stats.captured++;
+    } else {
+      hub_stats.capture_errors++;
+    }
+    portEXIT_CRITICAL(&hub_lock);
+    if (!frame) {
+      log_e("Frame copy failed");
+      continue;
+    }
+    frame->seq = ++seq;
+    frame->refs = 1;  // the hub's own reference, dropped after publishing
+
+    publish(frame);
+    frame_release(frame);
+    if (hub_stats.subscribers == 0) {
+      frame_pool_trim();  // the last client left while this was encoding
+    }
+  }
+}
+
+bool frame_hub_start(void) {
+  if (hub_running) {
+    return true;
+  }
+  for (int i = 0; i < FRAME_HUB_MAX_SUBS; i++) {
+    subs[i].in_use = false;
+    subs[i].pending = NULL;
+    if (!subs[i].ready) {
+      subs[i].ready = xSemaphoreCreateBinary();
+    }
+    if (!subs[i].ready) {
+      return false;
+    }
+  }
+  if (!encode_task && xTaskCreatePinnedToCore(encode_task_fn, "frame_encode", FRAME_HUB_TASK_STACK, NULL,
+                                              FRAME_HUB_TASK_PRIORITY, &encode_task, FRAME_HUB_ENCODE_CORE) != pdPASS) {
+    encode_task = NULL;
+    return false;
+  }
+  if (xTaskCreatePinnedToCore(capture_task_fn, "frame_capture", FRAME_HUB_TASK_STACK, NULL,
+                              FRAME_HUB_TASK_PRIORITY, &capture_task, FRAME_HUB_CAPTURE_CORE) != pdPASS) {
+    capture_task = NULL;
+    return false;
+  }
+  hub_running = true;
+  return true;
+}
+
+void frame_hub_set_pre_capture(frame_hub_hook_t hook) {
+  pre_capture = hook;
+}
+
+frame_sub_t *frame_hub_subscribe(void) {
+  if (!hub_running) {
+    return NULL;  // nothing would ever fill the slot
+  }
+  frame_sub_t *sub = NULL;
+  portENTER_CRITICAL(&hub_lock);
+  for (int i = 0; i < FRAME_HUB_MAX_SUBS; i++) {
+    if (!subs[i].in_use) {
+      sub = &subs[i];
+      sub->in_use = true;
+      sub->pending = NULL;
+      sub->dropped = 0;
+      hub_stats.subscribers++;
+      break;
+    }
+  }
+  portEXIT_CRITICAL(&hub_lock);
+
+  if (sub) {
+    xSemaphoreTake(sub->ready, 0);  // clear a stale wakeup
+    xTaskNotifyGive(capture_task);
+  }
+  return sub;
+}
+
+void frame_hub_unsubscribe(frame_sub_t *sub) {
+  portENTER_CRITICAL(&hub_lock);
+  frame_t *pending = sub->pending;
+  sub->pending = NULL;
+  sub->in_use = false;
+  bool last = (--hub_stats.subscribers == 0);
+  portEXIT_CRITICAL(&hub_lock);
+
+  frame_release(pending);
+  if (last) {
+    frame_pool_trim();  // nothing to stream; give the frame memory back
+  }
+}
+
+frame_t *frame_hub_wait(frame_sub_t *sub, TickType_t timeout) {
+  if (xSemaphoreTake(sub->ready, timeout) != pdTRUE) {
+    return NULL;
+  }
+  portENTER_CRITICAL(&hub_lock);
+  frame_t *frame = sub->pending;  // reference moves to the caller
+  sub->pending = NULL;
+  portEXIT_CRITICAL(&hub_lock);
+  return frame;
+}
+
+uint32_t frame_sub_dropped(const frame_sub_t *sub) {
+  return sub->dropped;
+}
+
+frame_hub_stats_t frame_hub_get_stats(void) {
+  // Written from both pipeline cores; copy under the lock so the 64-bit
+  // counters can't tear.
+  portENTER_CRITICAL(&hub_lock);
+  frame_hub_stats_t stats = hub_stats;
+  portEXIT_CRITICAL(&hub_lock);
+  return stats;
+}
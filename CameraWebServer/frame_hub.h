@@ -0,0 +1,82 @@
+#ifndef FRAME_HUB_H
+#define FRAME_HUB_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/time.h>
+#include "freertos/FreeRTOS.h"
+
+// One capture pipeline feeding every stream client.
+//
+// A capture task grabs frames and an encode task copies the JPEG out of
+// the camera buffer (so the driver gets it back straight away) and
+// publishes it to each subscriber. A subscriber only ever holds the frame
+// it's sending plus the newest one waiting; if it falls behind, the
+// waiting frame is replaced and counted as dropped, so a slow client never
+// slows the others down.
+#define FRAME_HUB_MAX_SUBS 4
+
+// Where each pipeline stage runs. Capture mostly waits on the sensor and
+// senders on lwIP, which lives on core 0; encoding is the CPU-heavy stage
+// and gets core 1 to itself. Single-core targets (ESP32-S2) run all three
+// on core 0. Defining all three in the build overrides this, so other
+// layouts can be compared against it in /metrics.
+#if defined(FRAME_HUB_CAPTURE_CORE) && defined(FRAME_HUB_ENCODE_CORE) && defined(FRAME_HUB_SEND_CORE)
+// layout given by the build
+#elif portNUM_PROCESSORS > 1
+#define FRAME_HUB_CAPTURE_CORE 0
+#define FRAME_HUB_ENCODE_CORE  1
+#define FRAME_HUB_SEND_CORE    0
+#else
+#define FRAME_HUB_CAPTURE_CORE 0
+#define FRAME_HUB_ENCODE_CORE  0
+#define FRAME_HUB_SEND_CORE    0
+#endif
+
+typedef struct {
+  uint8_t *buf;
+  size_t len;
+  struct timeval timestamp;  // sensor VSYNC, esp_timer clock
+  int64_t got_us;            // esp_camera_fb_get() returned
+  int64_t ready_us;          // copied/encoded and about to be published
+  uint32_t seq;
+  int quality;  // sensor JPEG quality the frame was captured at
+  int refs;  // guarded by the hub lock
+} frame_t;
+
+typedef struct frame_sub_s frame_sub_t;
+
+typedef struct {
+  uint32_t captured;
+  uint32_t capture_errors;
+  uint32_t dropped;  // frames replaced before a subscriber took them
+  uint32_t subscribers;
+  uint32_t ring_max;     // deepest the capture->encode ring has been
+  uint32_t ring_stalls;  // capture waited on a full ring
+  uint64_t capture_busy_us;
+  uint64_t encode_busy_us;
+} frame_hub_stats_t;
+
+// Called on the capture task before each capture; the place to change
+// sensor settings without racing the capture itself.
+typedef void (*frame_hub_hook_t)(void);
+
+// Start the capture and encode tasks. They sleep while nobody is
+// subscribed. Safe to call again after a failure.
+bool frame_hub_start(void);
+void frame_hub_set_pre_capture(frame_hub_hook_t hook);
+
+// NULL if all subscriber slots are taken or the hub isn't running.
+frame_sub_t *frame_hub_subscribe(void);
+void frame_hub_unsubscribe(frame_sub_t *sub);
+
+// Wait for a frame newer than the last one this subscriber took. The
+// caller owns a reference and must frame_release() it.
+frame_t *frame_hub_wait(frame_sub_t *sub, TickType_t timeout);
+void frame_release(frame_t *frame);
+
+uint32_t frame_sub_dropped(const frame_sub_t *sub);
+frame_hub_stats_t frame_hub_get_stats(void);
+
+#endif  // FRAME_HUB_H
@@ -0,0 +1,141 @@
+#include "frame_pool.h"
+#include "freertos/FreeRTOS.h"
+#include "esp_heap_caps.h"
+
+// JPEG sizes wander from frame to frame; grow with room to spare so the
+// pool settles instead of regrowing on every slightly larger frame.
+#define FRAME_POOL_ROUND 4096
+
+typedef struct {
+  uint8_t *buf;
+  size_t cap;
+  bool in_use;
+} pool_buf_t;
+
+// Everything below, stats included, is guarded by pool_lock.
+static portMUX_TYPE pool_lock = portMUX_INITIALIZER_UNLOCKED;
+static pool_buf_t pool[FRAME_POOL_BUFS];
+static int pool_bufs = 0;  // how many of pool[] to use; set on first get
+static frame_pool_stats_t pool_stats = {0, 0, 0, 0, 0};
+
+static uint8_t *heap_alloc(size_t len) {
+  uint8_t *buf = (uint8_t *)heap_caps_malloc(len, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+  if (!buf) {
+    buf = (uint8_t *)heap_caps_malloc(len, MALLOC_CAP_8BIT);
+  }
+  return buf;
+}
+
+uint8_t *frame_pool_get(size_t min_len, size_t *cap) {
+  pool_buf_t *fit = NULL;
+  pool_buf_t *grow = NULL;
+
+  if (!pool_bufs) {
+    pool_bufs = heap_caps_get_total_size(MALLOC_CAP_SPIRAM) ? FRAME_POOL_BUFS : FRAME_POOL_BUFS_NO_PSRAM;
+  }
+
+  // Prefer the smallest free buffer that's already big enough; otherwise
+  // claim one to grow, the largest free one so it needs the least.
+  portENTER_CRITICAL(&pool_lock);
+  for (int i = 0; i < pool_bufs; i++) {
+    pool_buf_t *p = &pool[i];
+    if (p->in_use) {
+      continue;
+    }
+    if (p->cap >= min_len) {
+      if (!fit || p->cap < fit->cap) {
+        fit = p;
+      }
+    } else if (!grow || p->cap > grow->cap) {
+      grow = p;
+    }
+  }
+  pool_buf_t *claimed = fit ? fit : grow;
+  if (claimed) {
+    claimed->in_use = true;
+  }
+  if (fit) {
+    pool_stats.hits++;
+  }
+  portEXIT_CRITICAL(&pool_lock);
+
+  if (fit) {
+    *cap = fit->cap;
+    return fit->buf;
+  }
+
+  if (grow) {
+    // Outside the lock: allocation can take a while and the buffer is ours.
+    size_t want = (min_len + min_len / 4 + FRAME_POOL_ROUND - 1) & ~(size_t)(FRAME_POOL_ROUND - 1);
+    size_t old_cap = grow->cap;
+    heap_caps_free(grow->buf);
+    uint8_t *buf = heap_alloc(want);
+    portENTER_CRITICAL(&pool_lock);
+    grow->buf = buf;
+    grow->cap = buf ? want : 0;
+    grow->in_use = buf != NULL;
+    pool_stats.bytes = pool_stats.bytes - old_cap + grow->cap;
+    if (buf) {
+      pool_stats.grows++;
+    }
+    portEXIT_CRITICAL(&pool_lock);
+    if (buf) {
+      *cap = want;
+      return buf;
+    }
+  }
+
+  portENTER_CRITICAL(&pool_lock);
+  pool_stats.misses++;
+  portEXIT_CRITICAL(&pool_lock);
+  uint8_t *buf = heap_alloc(min_len);
+  *cap = buf ? min_len : 0;
+  return buf;
+}
+
+void frame_pool_put(uint8_t *buf) {
+  if (!buf) {
+    return;
+  }
+  bool pooled = false;
+  portENTER_CRITICAL(&pool_lock);
+  for (int i = 0; i < pool_bufs; i++) {
+    if (pool[i].buf == buf) {
+      pool[i].in_use = false;
+      pooled = true;
+      break;
+    }
+  }
+  portEXIT_CRITICAL(&pool_lock);
+  if (!pooled) {
+    heap_caps_free(buf);
+  }
+}
+
+void frame_pool_trim(void) {
+  uint8_t *freed[FRAME_POOL_BUFS];
+  int n = 0;
+  portENTER_CRITICAL(&pool_lock);
+  for (int i = 0; i < pool_bufs; i++) {
+    pool_buf_t *p = &pool[i];
+    if (p->in_use || !p->buf) {
+      continue;
+    }
+    freed[n++] = p->buf;
+    pool_stats.bytes -= p->cap;
+    pool_stats.trims++;
+    p->buf = NULL;
+    p->cap = 0;
+  }
+  portEXIT_CRITICAL(&pool_lock);
+  for (int i = 0; i < n; i++) {
+    heap_caps_free(freed[i]);
+  }
+}
+
+frame_pool_stats_t frame_pool_get_stats(void) {
+  portENTER_CRITICAL(&pool_lock);
+  frame_pool_stats_t stats = pool_stats;
+  portEXIT_CRITICAL(&pool_lock);
+  return stats;
+}
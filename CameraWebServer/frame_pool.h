@@ -0,0 +1,36 @@
+#ifndef FRAME_POOL_H
+#define FRAME_POOL_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// Reusable PSRAM buffers for frame copies and encoder output.
+//
+// Buffers grow to the largest size asked for and then stay allocated, so
+// a steady stream does no allocation at all. When every buffer is busy
+// the caller gets a one-off heap buffer instead; frame_pool_put() tells
+// the two apart. Without PSRAM the buffers come out of internal RAM, so
+// the pool keeps fewer of them.
+#define FRAME_POOL_BUFS         8  // a sent and a pending frame per subscriber
+#define FRAME_POOL_BUFS_NO_PSRAM 3  // one client: sending, pending, encoding
+
+typedef struct {
+  uint32_t hits;
+  uint32_t misses;  // pool busy or out of memory; fell back to the heap
+  uint32_t grows;
+  uint32_t trims;   // buffers freed by frame_pool_trim()
+  size_t bytes;     // total pool capacity
+} frame_pool_stats_t;
+
+// A buffer of at least min_len bytes, or NULL. *cap gets its real size.
+uint8_t *frame_pool_get(size_t min_len, size_t *cap);
+void frame_pool_put(uint8_t *buf);
+
+// Free every buffer not currently handed out, e.g. once the last stream
+// has gone. The pool regrows on demand.
+void frame_pool_trim(void);
+
+frame_pool_stats_t frame_pool_get_stats(void);
+
+#endif  // FRAME_POOL_H
@@ -0,0 +1,99 @@
+#include "stream_metrics.h"
+#include "freertos/FreeRTOS.h"
+#include <string.h>
+
+// Upper bound of each bucket in microseconds; the last one is open.
+static const uint32_t bucket_us[METRIC_BUCKETS] = {
+  500,    1000,   2000,   3000,   5000,   7000,   10000,  15000,
+  20000,  30000,  40000,  50000,  70000,  100000, 150000, 200000,
+  300000, 500000, 700000, 1000000, 2000000, 5000000, 10000000, UINT32_MAX,
+};
+
+static portMUX_TYPE metrics_lock = portMUX_INITIALIZER_UNLOCKED;
+static metric_hist_t hists[METRIC_STAGES];
+static metric_counters_t counters;
+
+static const char *stage_names[METRIC_STAGES] = {"capture", "encode", "send", "total"};
+
+void metrics_record(metric_stage_t stage, int64_t us) {
+  if (us < 0) {
+    us = 0;
+  }
+  uint32_t v = us > UINT32_MAX ? UINT32_MAX : (uint32_t)us;
+  int b = 0;
+  while (b < METRIC_BUCKETS - 1 && v > bucket_us[b]) {
+    b++;
+  }
+  metric_hist_t *h = &hists[stage];
+  portENTER_CRITICAL(&metrics_lock);
+  h->counts[b]++;
+  h->count++;
+  h->sum_us += v;
+  if (v > h->max_us) {
+    h->max_us = v;
+  }
+  portEXIT_CRITICAL(&metrics_lock);
+}
+
+void metrics_frame_sent(uint32_t seq, uint32_t send_us) {
+  portENTER_CRITICAL(&metrics_lock);
+  counters.sent++;
+  counters.last_seq = seq;
+  counters.send_busy_us += send_us;
+  portEXIT_CRITICAL(&metrics_lock);
+}
+
+void metrics_socket_write(void) {
+  portENTER_CRITICAL(&metrics_lock);
+  counters.socket_writes++;
+  portEXIT_CRITICAL(&metrics_lock);
+}
+
+void metrics_frame_skipped(void) {
+  portENTER_CRITICAL(&metrics_lock);
+  counters.skipped++;
+  portEXIT_CRITICAL(&metrics_lock);
+}
+
+void metrics_fb_starved(void) {
+  portENTER_CRITICAL(&metrics_lock);
+  counters.fb_starved++;
+  portEXIT_CRITICAL(&metrics_lock);
+}
+
+void metrics_snapshot(metric_hist_t out[METRIC_STAGES], metric_counters_t *out_counters) {
+  portENTER_CRITICAL(&metrics_lock);
+  memcpy(out, hists, sizeof(hists));
+  *out_counters = counters;
+  portEXIT_CRITICAL(&metrics_lock);
+}
+
+// Interpolates linearly inside the bucket holding the p-th sample; the
+// open top bucket reports the maximum seen.
+int32_t metrics_percentile(const metric_hist_t *h, float p) {
+  if (h->count == 0) {
+    return -1;
+  }
+  float rank = p * h->count;
+  uint32_t seen = 0;
+  for (int b = 0; b < METRIC_BUCKETS; b++) {
+    if (h->counts[b] == 0) {
+      continue;
+    }
+    if (seen + h->counts[b] >= rank) {
+      if (b == METRIC_BUCKETS - 1) {
+        return h->max_us;
+      }
+      uint32_t lo = b ? bucket_us[b - 1] : 0;
+      uint32_t hi = bucket_us[b] < h->max_us ? bucket_us[b] : h->max_us;
+      float frac = (rank - seen) / h->counts[b];
+      return (int32_t)(lo + frac * (hi > lo ? hi - lo : 0));
+    }
+    seen += h->counts[b];
+  }
+  return h->max_us;
+}
+
+const char *metrics_stage_name(metric_stage_t stage) {
+  return stage_names[stage];
+}
@@ -0,0 +1,53 @@
+#ifndef STREAM_METRICS_H
+#define STREAM_METRICS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// Per-frame stage timings for the streams, kept as fixed histograms so
+// percentiles come cheap and memory stays constant.
+//
+//   capture: sensor timestamp (VSYNC) -> esp_camera_fb_get() returned
+//   encode:  fb_get -> frame copied/encoded and published
+//   send:    published -> last byte handed to the socket, per client
+//   total:   sensor timestamp -> last byte, per client
+typedef enum {
+  METRIC_CAPTURE,
+  METRIC_ENCODE,
+  METRIC_SEND,
+  METRIC_TOTAL,
+  METRIC_STAGES
+} metric_stage_t;
+
+#define METRIC_BUCKETS 24
+
+typedef struct {
+  uint32_t counts[METRIC_BUCKETS];
+  uint32_t count;
+  uint32_t max_us;
+  uint64_t sum_us;
+} metric_hist_t;
+
+typedef struct {
+  uint32_t sent;        // frames delivered to clients
+  uint32_t skipped;     // frames a client's rate controller passed over
+  uint32_t fb_starved;  // fb_get came back empty
+  uint32_t last_seq;
+  uint64_t send_busy_us;  // time spent in socket writes, all clients
+  uint32_t socket_writes; // lwip_writev calls by the stream and ws senders
+} metric_counters_t;
+
+void metrics_record(metric_stage_t stage, int64_t us);
+void metrics_frame_sent(uint32_t seq, uint32_t send_us);
+void metrics_frame_skipped(void);
+void metrics_fb_starved(void);
+void metrics_socket_write(void);
+
+// Copy out everything under one lock.
+void metrics_snapshot(metric_hist_t hists[METRIC_STAGES], metric_counters_t *counters);
+// In microseconds, p in 0..1; -1 if there are no samples.
+int32_t metrics_percentile(const metric_hist_t *h, float p);
+const char *metrics_stage_name(metric_stage_t stage);
+
+#endif  // STREAM_METRICS_H
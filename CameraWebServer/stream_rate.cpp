@@ -0,0 +1,124 @@
+#include "stream_rate.h"
+#include "freertos/FreeRTOS.h"
+
+#define STREAM_RATE_MAX_QUALITY  40   // past this JPEG artifacts swamp the image
+#define STREAM_RATE_HOLD_SENDS   5    // let a change take effect before the next
+#define STREAM_RATE_CALM_SENDS   30   // sends under half the target before easing off
+
+typedef struct {
+  uint8_t quality_step;
+  uint8_t skip;  // frames skipped between sent ones
+} stream_level_t;
+
+static const stream_level_t levels[] = {
+  {0, 0}, {4, 0}, {8, 0}, {12, 0}, {16, 1}, {20, 1}, {24, 2}, {28, 3},
+};
+#define STREAM_RATE_LEVELS (sizeof(levels) / sizeof(levels[0]))
+
+static portMUX_TYPE rate_lock = portMUX_INITIALIZER_UNLOCKED;
+static bool slot_used[STREAM_RATE_MAX_CLIENTS];
+static uint8_t slot_level[STREAM_RATE_MAX_CLIENTS];
+
+bool stream_rate_open(stream_rate_t *r, uint32_t target_us) {
+  r->slot = -1;
+  r->level = 0;
+  r->skipped = 0;
+  r->calm = 0;
+  r->since_change = 0;
+  r->target_us = target_us;
+  r->send_avg_us = 0;
+
+  portENTER_CRITICAL(&rate_lock);
+  for (int i = 0; i < STREAM_RATE_MAX_CLIENTS; i++) {
+    if (!slot_used[i]) {
+      slot_used[i] = true;
+      slot_level[i] = 0;
+      r->slot = i;
+      break;
+    }
+  }
+  portEXIT_CRITICAL(&rate_lock);
+  return r->slot >= 0;
+}
+
+void stream_rate_close(stream_rate_t *r) {
+  if (r->slot < 0) {
+    return;
+  }
+  portENTER_CRITICAL(&rate_lock);
+  slot_used[r->slot] = false;
+  slot_level[r->slot] = 0;
+  portEXIT_CRITICAL(&rate_lock);
+  r->slot = -1;
+}
+
+static void set_level(stream_rate_t *r, uint8_t level) {
+  r->level = level;
+  r->since_change = 0;
+  r->calm = 0;
+  if (r->slot >= 0) {
+    portENTER_CRITICAL(&rate_lock);
+    slot_level[r->slot] = level;
+    portEXIT_CRITICAL(&rate_lock);
+  }
+}
+
+bool stream_rate_should_send(stream_rate_t *r) {
+  if (r->skipped < levels[r->level].skip) {
+    r->skipped++;
+    return false;
+  }
+  r->skipped = 0;
+  return true;
+}
+
+void stream_rate_sample(stream_rate_t *r, uint32_t send_us) {
+  if (r->send_avg_us == 0) {
+    r->send_avg_us = send_us;
+  } else {
+    r->send_avg_us += ((int32_t)send_us - (int32_t)r->send_avg_us) / 4;
+  }
+  if (r->since_change < UINT16_MAX) {
+    r->since_change++;
+  }
+
+  if (r->send_avg_us > r->target_us) {
+    r->calm = 0;
+    if (r->since_change >= STREAM_RATE_HOLD_SENDS && r->level + 1 < (int)STREAM_RATE_LEVELS) {
+      set_level(r, r->level + 1);
+    }
+  } else if (r->send_avg_us < r->target_us / 2) {
+    if (++r->calm >= STREAM_RATE_CALM_SENDS && r->level > 0) {
+      set_level(r, r->level - 1);
+    }
+  } else {
+    r->calm = 0;
+  }
+}
+
+uint8_t stream_rate_skip(const stream_rate_t *r) {
+  return levels[r->level].skip;
+}
+
+uint8_t stream_rate_shared_level(void) {
+  uint8_t level = 0;
+  portENTER_CRITICAL(&rate_lock);
+  for (int i = 0; i < STREAM_RATE_MAX_CLIENTS; i++) {
+    if (slot_used[i] && slot_level[i] > level) {
+      level = slot_level[i];
+    }
+  }
+  portEXIT_CRITICAL(&rate_lock);
+  return level;
+}
+
+int stream_rate_quality(int base_quality, uint8_t level) {
+  if (level >= STREAM_RATE_LEVELS) {
+    level = STREAM_RATE_LEVELS - 1;
+  }
+  if (base_quality >= STREAM_RATE_MAX_QUALITY) {
+    return base_quality;
+  }
+  int q = base_quality + levels[level].quality_step;
+  return q > STREAM_RATE_MAX_QUALITY ? STREAM_RATE_MAX_QUALITY : q;
+}
@@ -0,0 +1,43 @@
+#ifndef STREAM_RATE_H
+#define STREAM_RATE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Per-client latency controller for /stream.
+//
+// lwIP doesn't tell us how much is still queued on a socket, but a send
+// that blocks means the buffer is full, so the time spent in send is the
+// congestion signal. Each client walks a ladder of levels: first lower
+// JPEG quality, then also skip frames. The sensor is shared, so its
+// quality follows the most congested client; skipping is per client.
+#define STREAM_RATE_MAX_CLIENTS 4
+#define STREAM_RATE_TARGET_US   60000
+
+typedef struct {
+  int slot;
+  uint8_t level;
+  uint8_t skipped;       // frames skipped since the last one sent
+  uint16_t calm;         // consecutive sends well under target
+  uint16_t since_change; // sends since the level last moved
+  uint32_t target_us;
+  uint32_t send_avg_us;  // smoothed time spent in send per frame
+} stream_rate_t;
+
+// false if all client slots are taken; the stream still works unadapted.
+bool stream_rate_open(stream_rate_t *r, uint32_t target_us);
+void stream_rate_close(stream_rate_t *r);
+
+// Whether to send this frame or skip it at the current level.
+bool stream_rate_should_send(stream_rate_t *r);
+// Feed back how long one frame took to send.
+void stream_rate_sample(stream_rate_t *r, uint32_t send_us);
+
+uint8_t stream_rate_skip(const stream_rate_t *r);
+
+// Highest level across open clients, and the JPEG quality for it given
+// the quality the user picked (higher numbers are lower quality).
+uint8_t stream_rate_shared_level(void);
+int stream_rate_quality(int base_quality, uint8_t level);
+
+#endif  // STREAM_RATE_H
@@ -0,0 +1,158 @@
+// buttons.cpp
+#include "buttons.h"
+
+const unsigned long BTN_DEBOUNCE_MS = 30;
+const unsigned long BTN_LONG_MS     = 600;
+const unsigned long BTN_REPEAT_MS   = 150;
+
+#define EDGE_QUEUE_LEN 16 // power of two
+
+typedef struct {
+  uint8_t button;
+  bool pressed;
+  unsigned long ms;
+} button_edge;
+
+// Single producer (ISRs) / single consumer (loop) ring: the ISR only
+// writes edgeHead, the loop only writes edgeTail.
+static button_edge edgeQueue[EDGE_QUEUE_LEN];
+static volatile uint8_t edgeHead = 0;
+static volatile uint8_t edgeTail = 0;
+static volatile unsigned long edgeOverflows = 0;
+
+static uint8_t btnPins[BTN_MAX];
+static uint8_t btnCount = 0;
+static bool    btnHasIrq[BTN_MAX];
+
+// ISR-side debounce state
+static volatile bool          isrPressed[BTN_MAX];
+static volatile unsigned long isrLastEdgeMs[BTN_MAX];
+static volatile bool          isrRecheck[BTN_MAX]; // change ignored inside the window
+
+// Loop-side press tracking
+static bool          held[BTN_MAX];
+static bool          longFired[BTN_MAX];
+static unsigned long pressStartMs[BTN_MAX];
+static unsigned long nextRepeatMs[BTN_MAX];
+
+// Pending output events (a poll can produce more than one)
+#define EVENT_QUEUE_LEN 8
+static button_event events[EVENT_QUEUE_LEN];
+static uint8_t eventHead = 0;
+static uint8_t eventCount = 0;
+
+static void pushEdge(uint8_t i, bool pressed, unsigned long ms) {
+  uint8_t next = (edgeHead + 1) & (EDGE_QUEUE_LEN - 1);
+  if (next == edgeTail) {
+    edgeOverflows++;
+    return;
+  }
+  edgeQueue[edgeHead].button  = i;
+  edgeQueue[edgeHead].pressed = pressed;
+  edgeQueue[edgeHead].ms      = ms;
+  edgeHead = next;
+}
+
+// Accept a level change only if this button has been quiet for the
+// debounce window; other buttons are unaffected. A change that lands
+// inside the window is flagged so the loop reads the pin once it's over.
+static void onEdge(uint8_t i) {
+  unsigned long now = millis();
+  bool pressed = (digitalRead(btnPins[i]) == LOW);
+  isrRecheck[i] = false;
+  if (pressed == isrPressed[i]) return;
+  if (now - isrLastEdgeMs[i] < BTN_DEBOUNCE_MS) {
+    isrRecheck[i] = true;
+    return;
+  }
+  isrPressed[i]    = pressed;
+  isrLastEdgeMs[i] = now;
+  pushEdge(i, pressed, now);
+}
+
+static void btnIsr0() { onEdge(0); }
+static void btnIsr1() { onEdge(1); }
+static void btnIsr2() { onEdge(2); }
+static void btnIsr3() { onEdge(3); }
+static void (*const btnIsrs[BTN_MAX])() = { btnIsr0, btnIsr1, btnIsr2, btnIsr3 };
+
+static void emit(uint8_t i, button_event_type type) {
+  if (eventCount == EVENT_QUEUE_LEN) return;
+  uint8_t tail = (eventHead + eventCount) % EVENT_QUEUE_LEN;
+  events[tail].button = i;
+  events[tail].type   = type;
+  eventCount++;
+}
+
+void buttons_begin(const uint8_t *pins, uint8_t count) {
+  btnCount = count > BTN_MAX ? BTN_MAX : count;
+  for (uint8_t i = 0; i < btnCount; i++) {
+    btnPins[i] = pins[i];
+    pinMode(pins[i], INPUT_PULLUP);
+    isrPressed[i]    = (digitalRead(pins[i]) == LOW);
+    isrLastEdgeMs[i] = 0;
+    isrRecheck[i]    = false;
+    held[i]          = false;
+    longFired[i]     = false;
+
+    int irq = digitalPinToInterrupt(pins[i]);
+    btnHasIrq[i] = (irq >= 0);
+    if (btnHasIrq[i]) {
+      attachInterrupt(irq, btnIsrs[i], CHANGE);
+    } else {
+      Serial.print("[BTN] no interrupt on pin ");
+      Serial.print(pins[i]);
+      Serial.println(", sampling it from the loop");
+    }
+  }
+}
+
+bool buttons_poll(unsigned long nowMs, button_event &ev) {
+  for (uint8_t i = 0; i < btnCount; i++) {
+    // Pins without an interrupt are sampled here instead. Interrupt pins
+    // are only read again when their last change landed inside the
+    // debounce window and was ignored, once that window has passed.
+    if (!btnHasIrq[i] || (isrRecheck[i] && nowMs - isrLastEdgeMs[i] >= BTN_DEBOUNCE_MS)) {
+      noInterrupts();
+      onEdge(i);
+      interrupts();
+    }
+  }
+
+  while (edgeTail != edgeHead) {
+    button_edge e = edgeQueue[edgeTail];
+    edgeTail = (edgeTail + 1) & (EDGE_QUEUE_LEN - 1);
+
+    uint8_t i = e.button;
+    if (e.pressed) {
+      held[i]         = true;
+      longFired[i]    = false;
+      pressStartMs[i] = e.ms;
+    } else if (held[i]) {
+      held[i] = false;
+      if (!longFired[i]) emit(i, BTN_TAP);
+    }
+  }
+
+  for (uint8_t i = 0; i < btnCount; i++) {
+    if (!held[i]) continue;
+    if (!longFired[i] && nowMs - pressStartMs[i] >= BTN_LONG_MS) {
+      longFired[i]    = true;
+      nextRepeatMs[i] = nowMs + BTN_REPEAT_MS;
+      emit(i, BTN_LONG);
+    } else if (longFired[i] && (long)(nowMs - nextRepeatMs[i]) >= 0) {
+      nextRepeatMs[i] += BTN_REPEAT_MS;
+      emit(i, BTN_REPEAT);
+    }
+  }
+
+  if (eventCount == 0) return false;
+  ev = events[eventHead];
+  eventHead = (eventHead + 1) % EVENT_QUEUE_LEN;
+  eventCount--;
+  return true;
+}
+
+unsigned long buttons_overflows() {
+  return edgeOverflows;
+}
@@ -0,0 +1,29 @@
+// buttons.h
+#pragma once
+#include <Arduino.h>
+
+// Debounced push buttons (active LOW, INPUT_PULLUP) fed by pin-change
+// interrupts. Edges are timestamped in the ISR and pushed onto a small
+// lock-free queue, so presses aren't lost while the loop is busy; the loop
+// turns them into tap / long-press / repeat events.
+
+#define BTN_MAX 4
+
+typedef enum {
+  BTN_TAP    = 0, // released before the long-press time
+  BTN_LONG   = 1, // held past the long-press time
+  BTN_REPEAT = 2, // still held, fires every repeat interval after BTN_LONG
+} button_event_type;
+
+typedef struct {
+  uint8_t button;          // index into the pins passed to buttons_begin
+  button_event_type type;
+} button_event;
+
+void buttons_begin(const uint8_t *pins, uint8_t count);
+
+// Returns true and fills ev while there are events to hand out.
+bool buttons_poll(unsigned long nowMs, button_event &ev);
+
+// Edges dropped because the ISR queue was full.
+unsigned long buttons_overflows();
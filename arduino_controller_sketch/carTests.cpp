@@ -1,12 +1,21 @@
 #include <Arduino.h>
 #include "rc_car.h"
 #include "fsm.h"
+#include "link_governor.h"
+#include "jitter_buffer.h"
+#include "latency_stats.h"
+#include "clock_sync.h"
+#include "dfplayer_protocol.h"
+#include "track_catalog.h"
+#include "http_response.h"
+#include "sound_cues.h"
+#include "wifi_manager.h"
+#include "clamp.h"
+#include <string.h>
 
 #define TESTING   // toggle this on/off as needed
 
 // Prototypes for helpers defined in servo_circuit.ino
-int   clampInt(int val, int minVal, int maxVal);
-float clampFloat(float val, float minVal, float maxVal);
 int   getParamValue(const String &query, const String &name, bool &found);
 
 // --------- CAR FSM TESTING HELPERS ---------
@@ -191,6 +200,330 @@ bool testGetParamValueSuite() {
   return ok;
 }
 
+bool testLinkGovernorSuite() {
+  bool ok = true;
+
+  // Curve endpoints and interpolation
+  ok &= assertEqualInt("linkThrottleCap clean link",  255, linkThrottleCap(0.0f));
+  ok &= assertEqualInt("linkThrottleCap midpoint",    170, linkThrottleCap(115.0f));
+  ok &= assertEqualInt("linkThrottleCap very bad",     90, linkThrottleCap(1000.0f));
+
+  // No command yet -> no throttle at all
+  link_state s = initLinkGovernor(0);
+  s = updateLinkGovernor(s, 200, 10);
+  ok &= assertEqualInt("governor NO_LINK blocks throttle", 0, s.outThrottle);
+
+  // Steady 100ms commands -> full throttle passes through
+  for (unsigned long t = 100; t <= 1000; t += 100) {
+    s = linkOnCommand(s, t);
+  }
+  s = updateLinkGovernor(s, 200, 1010);
+  ok &= assertEqualInt("governor steady link passes throttle", 200, s.outThrottle);
+  ok &= assertEqualInt("governor steady link mode OK", l_OK, s.mode);
+
+  // Command is late -> cap shrinks
+  s = updateLinkGovernor(s, 255, 1180);
+  ok &= assertEqualInt("governor late command caps throttle", 200, s.outThrottle);
+  s = updateLinkGovernor(s, 255, 1450);
+  ok &= assertEqualInt("governor very late command caps harder", 90, s.outThrottle);
+  ok &= assertEqualInt("governor very late command mode DEGRADED", l_DEGRADED, s.mode);
+
+  // Silent past the deadline -> ramps down, then stops
+  s = updateLinkGovernor(s, 255, 1510);
+  ok &= assertEqualInt("governor lost link mode LOST", l_LOST, s.mode);
+  ok &= assertEqualInt("governor lost link ramps down", 41, s.outThrottle);
+  s = updateLinkGovernor(s, 255, 2000);
+  ok &= assertEqualInt("governor lost link reaches stop", 0, s.outThrottle);
+
+  // A new command brings the link back
+  s = linkOnCommand(s, 2050);
+  s = updateLinkGovernor(s, -120, 2060);
+  ok &= assertEqualInt("governor recovered link passes reverse", -120, s.outThrottle);
+
+  return ok;
+}
+
+bool testJitterBufferSuite() {
+  bool ok = true;
+  jitter_buffer jb;
+  int th = 0, tu = 0;
+
+  jbReset(jb);
+  ok &= assertEqualInt("jb empty has no playout", 0, jbPlayout(jb, 0, th, tu));
+
+  // Phone clock is 1000ms behind ours, perfectly regular 50ms arrivals.
+  jbPush(jb, 0,   0,   0, 1000);
+  jbPush(jb, 50,  100, 0, 1050);
+  jbPush(jb, 100, 200, 0, 1100);
+  ok &= assertEqualInt("jb clean link adds no delay", 0, (int)jb.delayMs);
+
+  jbPlayout(jb, 1075, th, tu);
+  ok &= assertEqualInt("jb interpolates between samples", 150, th);
+
+  // Past the newest sample: extrapolate the trend, bounded by the horizon.
+  jbPlayout(jb, 1125, th, tu);
+  ok &= assertEqualInt("jb extrapolates short gap", 250, th);
+  ok &= assertEqualInt("jb reports extrapolation", 1, jb.extrapolating);
+  jbPlayout(jb, 1400, th, tu);
+  ok &= assertEqualInt("jb extrapolation is bounded", 255, th);
+
+  // Slowing down must not extrapolate into reverse.
+  jbReset(jb);
+  jbPush(jb, 0,  60, 0, 1000);
+  jbPush(jb, 50, 20, 0, 1050);
+  jbPlayout(jb, 1200, th, tu);
+  ok &= assertEqualInt("jb never extrapolates through zero", 0, th);
+
+  // Out-of-order arrival is slotted back in order.
+  jbReset(jb);
+  jbPush(jb, 0,   10, 0, 1000);
+  jbPush(jb, 100, 30, 0, 1100);
+  jbPush(jb, 50,  20, 0, 1100);
+  ok &= assertEqualInt("jb reorders late sample", 50, (int)jb.slots[1].clientMs);
+
+  // Bursty arrivals grow the playout delay.
+  jbReset(jb);
+  for (unsigned long i = 0; i < 40; i++) {
+    unsigned long arrive = 1000 + i * 50 + ((i % 2) ? 60 : 0);
+    jbPush(jb, i * 50, 100, 0, arrive);
+  }
+  ok &= assertEqualInt("jb jitter grows playout delay", 1, jb.delayMs > 40);
+
+  return ok;
+}
+
+bool testLatencyStatsSuite() {
+  bool ok = true;
+  latency_stats st;
+  latInit(st, 4);
+
+  ok &= assertEqualInt("latPercentile empty", 0, (int)latPercentile(st, 50));
+
+  // 1..100ms, one sample each
+  for (unsigned long v = 1; v <= 100; v++) latRecord(st, v);
+  ok &= assertEqualInt("latency count",  100, (int)st.count);
+  ok &= assertEqualInt("latency p50",     52, (int)latPercentile(st, 50));
+  ok &= assertEqualInt("latency p90",     92, (int)latPercentile(st, 90));
+  ok &= assertEqualInt("latency p100",   100, (int)latPercentile(st, 100));
+
+  // Past the last bucket lands in overflow and reports the max
+  latRecord(st, 5000);
+  ok &= assertEqualInt("latency overflow", 1, (int)st.overflow);
+  ok &= assertEqualInt("latency p100 overflow", 5000, (int)latPercentile(st, 100));
+  return ok;
+}
+
+bool testClockSyncSuite() {
+  bool ok = true;
+  clock_sync_state cs;
+  clockSyncInit(cs);
+
+  // Phone runs 5s ahead of us and 100ppm fast; exchanges every 2s.
+  for (int i = 0; i < 40; i++) {
+    uint64_t local = 1000000ULL + (uint64_t)i * 2000000ULL;
+    int64_t  off   = 5000000 + (int64_t)(local / 10000);
+    clockSyncUpdate(cs, local, off, 4000);
+  }
+  uint64_t probe = 100000000ULL;
+  int64_t  truth = (int64_t)probe + 5000000 + (int64_t)(probe / 10000);
+  int64_t  err   = clockSyncToPhoneUs(cs, probe) - truth;
+  ok &= assertEqualInt("clockSync converges within 1ms", 1, err > -1000 && err < 1000);
+
+  // An exchange that sat in a queue is ignored.
+  uint32_t rejected = cs.rejected;
+  clockSyncUpdate(cs, 90000000ULL, 0, 50000);
+  ok &= assertEqualInt("clockSync rejects slow exchange", (int)rejected + 1, (int)cs.rejected);
+  return ok;
+}
+
+bool testDFPlayerProtocolSuite() {
+  bool ok = true;
+  uint8_t frame[DF_FRAME_LEN];
+
+  // Play track 1: 7E FF 06 03 00 00 01 FE F7 EF
+  dfEncodeFrame(frame, 0x03, 1, false);
+  ok &= assertEqualInt("dfEncodeFrame checksum high", 0xFE, frame[7]);
+  ok &= assertEqualInt("dfEncodeFrame checksum low",  0xF7, frame[8]);
+  ok &= assertEqualInt("dfEncodeFrame end byte",      0xEF, frame[9]);
+
+  df_parser p;
+  df_frame f = {0, 0, 0};
+  dfParserReset(p);
+
+  // Garbage, then a valid current-track reply (track 5)
+  uint8_t rx[] = {0x00, 0x7E, 0x12, 0x7E, 0xFF, 0x06, 0x4C, 0x00, 0x00, 0x05, 0xFE, 0xAA, 0xEF};
+  int frames = 0;
+  for (unsigned i = 0; i < sizeof(rx); i++) {
+    if (dfParserFeed(p, rx[i], f)) frames++;
+  }
+  ok &= assertEqualInt("dfParser resyncs to one frame", 1, frames);
+  ok &= assertEqualInt("dfParser reply cmd",   0x4C, f.cmd);
+  ok &= assertEqualInt("dfParser reply param", 5,    f.param);
+
+  // Round trip through the encoder, then corrupt the checksum
+  dfEncodeFrame(frame, 0x06, 20, true);
+  frames = 0;
+  for (int i = 0; i < DF_FRAME_LEN; i++) {
+    if (dfParserFeed(p, frame[i], f)) frames++;
+  }
+  ok &= assertEqualInt("dfParser round trip", 1, frames);
+  ok &= assertEqualInt("dfParser round trip param", 20, f.param);
+  frame[8] ^= 0x01;
+  for (int i = 0; i < DF_FRAME_LEN; i++) {
+    if (dfParserFeed(p, frame[i], f)) frames++;
+  }
+  ok &= assertEqualInt("dfParser rejects bad checksum", 1, frames);
+  ok &= assertEqualInt("dfParser counts bad checksum", 1, (int)p.badChecksum);
+  return ok;
+}
+
+bool testTrackCatalogSuite() {
+  bool ok = true;
+  track_catalog c;
+
+  catalogMake(c, 42);
+  ok &= assertEqualInt("catalogMake valid",       1,  catalogValid(c) ? 1 : 0);
+  ok &= assertEqualInt("catalogMake track count", 42, c.trackCount);
+
+  catalogMake(c, 1000);
+  ok &= assertEqualInt("catalogMake clamps count", CATALOG_MAX_TRACKS, c.trackCount);
+
+  // Any corrupted field must fail the checksum
+  catalogMake(c, 42);
+  c.trackCount = 43;
+  ok &= assertEqualInt("catalogValid rejects changed count", 0, catalogValid(c) ? 1 : 0);
+
+  catalogMake(c, 42);
+  c.checksum ^= 0x0100;
+  ok &= assertEqualInt("catalogValid rejects bad checksum", 0, catalogValid(c) ? 1 : 0);
+
+  // An empty count is what an unmounted card reports; never trust it
+  catalogMake(c, 0);
+  ok &= assertEqualInt("catalogValid rejects zero count", 0, catalogValid(c) ? 1 : 0);
+
+  // Erased flash reads back as 0xFF
+  memset(&c, 0xFF, sizeof(c));
+  ok &= assertEqualInt("catalogValid rejects erased flash", 0, catalogValid(c) ? 1 : 0);
+  return ok;
+}
+
+bool testSoundCueSuite() {
+  bool ok = true;
+
+  // fsmEvent: forward drive cut by the obstacle check
+  full_state moving  = {100.0f, 150, 0, s_MOVE};
+  full_state blocked = {15.0f, 0, 0, s_MOVE};
+  ok &= assertEqualInt("fsmEvent obstacle stop", e_OBSTACLE_STOP, fsmEvent(moving, blocked, 150));
+  ok &= assertEqualInt("fsmEvent release is not obstacle", e_NONE, fsmEvent(moving, blocked, 0));
+  full_state idle = {100.0f, 0, 0, s_IDLE};
+  ok &= assertEqualInt("fsmEvent start", e_START, fsmEvent(idle, moving, 150));
+  ok &= assertEqualInt("fsmEvent stop",  e_STOP,  fsmEvent(moving, idle, 0));
+
+  cue_queue q;
+  cueInit(q);
+
+  // Highest priority pending cue goes first; the lower one it
+  // superseded is dropped rather than played late
+  cueTrigger(q, CUE_LINK_DEGRADED, 1000);
+  cueTrigger(q, CUE_LINK_LOST, 1001);
+  ok &= assertEqualInt("cueNext picks highest priority", CUE_LINK_LOST, cueNext(q, 1002));
+  ok &= assertEqualInt("cueNext trigger time", 1001, (int)q.playingTriggerMs);
+  cueFinished(q);
+  ok &= assertEqualInt("cueNext drops superseded cue", CUE_NONE, cueNext(q, 1500));
+
+  // A higher cue preempts a playing lower one
+  cueTrigger(q, CUE_LINK_DEGRADED, 1500);
+  ok &= assertEqualInt("cueNext lower cue plays", CUE_LINK_DEGRADED, cueNext(q, 1501));
+  cueTrigger(q, CUE_OBSTACLE, 1600);
+  ok &= assertEqualInt("cueNext preempts", CUE_OBSTACLE, cueNext(q, 1601));
+
+  // Same cue again inside the hold-off is ignored; after it, accepted
+  cueFinished(q);
+  cueTrigger(q, CUE_OBSTACLE, 2000);
+  ok &= assertEqualInt("cueTrigger hold-off", CUE_NONE, cueNext(q, 2001));
+  cueTrigger(q, CUE_OBSTACLE, 3700);
+  ok &= assertEqualInt("cueTrigger after hold-off", CUE_OBSTACLE, cueNext(q, 3701));
+
+  // A cue whose end is never reported stops blocking lower ones
+  cueTrigger(q, CUE_LINK_RESTORED, 3800);
+  ok &= assertEqualInt("cueNext blocked while playing", CUE_NONE, cueNext(q, 4000));
+  ok &= assertEqualInt("cueNext after play timeout", CUE_LINK_RESTORED, cueNext(q, 6701));
+
+  // One that waits past CUE_MAX_WAIT_MS is dropped
+  cueFinished(q);
+  cueTrigger(q, CUE_OBSTACLE, 10000);
+  ok &= assertEqualInt("cueNext stale setup", CUE_OBSTACLE, cueNext(q, 10000));
+  cueTrigger(q, CUE_LINK_RESTORED, 10100);
+  ok &= assertEqualInt("cueNext drops stale cue", CUE_NONE, cueNext(q, 14200));
+  return ok;
+}
+
+bool testWifiManagerSuite() {
+  bool ok = true;
+
+  const uint8_t ip[4]   = {192, 168, 1, 18};
+  const uint8_t gw[4]   = {192, 168, 1, 1};
+  const uint8_t mask[4] = {255, 255, 255, 0};
+  const uint8_t dns[4]  = {192, 168, 1, 1};
+
+  wifi_cache c;
+  wifiCacheMake(c, ip, gw, mask, dns);
+  ok &= assertEqualInt("wifiCache valid", 1, wifiCacheValid(c) ? 1 : 0);
+  c.ip[3] = 19;
+  ok &= assertEqualInt("wifiCache rejects changed ip", 0, wifiCacheValid(c) ? 1 : 0);
+  memset(&c, 0xFF, sizeof(c));
+  ok &= assertEqualInt("wifiCache rejects erased flash", 0, wifiCacheValid(c) ? 1 : 0);
+  memset(&c, 0, sizeof(c));
+  ok &= assertEqualInt("wifiCache rejects cleared record", 0, wifiCacheValid(c) ? 1 : 0);
+
+  // Doubles from 500 ms and stays capped
+  ok &= assertEqualInt("wifiBackoff first",  500,  (int)wifiBackoffMs(0));
+  ok &= assertEqualInt("wifiBackoff second", 1000, (int)wifiBackoffMs(1));
+  ok &= assertEqualInt("wifiBackoff capped", 8000, (int)wifiBackoffMs(10));
+  ok &= assertEqualInt("wifiBackoff huge",   8000, (int)wifiBackoffMs(1000000));
+  return ok;
+}
+
+static http_response testResp;
+
+bool testHttpResponseSuite() {
+  bool ok = true;
+  http_response &r = testResp;
+
+  respReset(r);
+  jsonOpen(r, '{');
+  jsonKey(r, "a");   jsonInt(r, -12);
+  jsonKey(r, "b");   jsonOpen(r, '[');
+  jsonUInt(r, 1);    jsonBool(r, true);  jsonString(r, "x\"y");
+  jsonClose(r, ']');
+  jsonKey(r, "big"); jsonUInt(r, 18446744073709551615ULL);
+  jsonKey(r, "f");   jsonFloat(r, -2.5f, 2);
+  jsonClose(r, '}');
+
+  size_t len = 0;
+  const char *out = respFinish(r, 200, "application/json", len);
+  const char *body = strstr(out, "\r\n\r\n");
+  ok &= assertEqualInt("respFinish header/body split", 1, body != NULL ? 1 : 0);
+  if (body) {
+    body += 4;
+    const char *expected =
+      "{\"a\":-12,\"b\":[1,true,\"x\\\"y\"],\"big\":18446744073709551615,\"f\":-2.50}";
+    ok &= assertEqualInt("json writer output", 1,
+                         (strlen(expected) == (size_t)(out + len - body) &&
+                          memcmp(body, expected, strlen(expected)) == 0) ? 1 : 0);
+  }
+  ok &= assertEqualInt("respFinish status line", 0, strncmp(out, "HTTP/1.1 200 OK\r\n", 17));
+  ok &= assertEqualInt("respFinish content length", 1,
+                       strstr(out, "Content-Length: 66\r\n") != NULL ? 1 : 0);
+
+  // A body that doesn't fit becomes a 500 rather than a truncated reply
+  respReset(r);
+  for (int i = 0; i < HTTP_BODY_MAX; i++) respStr(r, "ab");
+  out = respFinish(r, 200, "application/json", len);
+  ok &= assertEqualInt("respFinish overflow status", 0, strncmp(out, "HTTP/1.1 500", 12));
+  return ok;
+}
+
 bool testAllCarFSM() {
 #ifndef TESTING
   Serial.println("Car FSM tests not compiled. Define TESTING to enable.");
@@ -208,6 +541,33 @@ bool testAllCarFSM() {
   Serial.println("Running getParamValue tests...");
   if (!testGetParamValueSuite()) allPass = false;
 
+  Serial.println("Running link governor tests...");
+  if (!testLinkGovernorSuite()) allPass = false;
+
+  Serial.println("Running jitter buffer tests...");
+  if (!testJitterBufferSuite()) allPass = false;
+
+  Serial.println("Running latency stats tests...");
+  if (!testLatencyStatsSuite()) allPass = false;
+
+  Serial.println("Running clock sync tests...");
+  if (!testClockSyncSuite()) allPass = false;
+
+  Serial.println("Running DFPlayer protocol tests...");
+  if (!testDFPlayerProtocolSuite()) allPass = false;
+
+  Serial.println("Running track catalog tests...");
+  if (!testTrackCatalogSuite()) allPass = false;
+
+  Serial.println("Running HTTP response tests...");
+  if (!testHttpResponseSuite()) allPass = false;
+
+  Serial.println("Running sound cue tests...");
+  if (!testSoundCueSuite()) allPass = false;
+
+  Serial.println("Running WiFi manager tests...");
+  if (!testWifiManagerSuite()) allPass = false;
+
   auto makeIdleState = [](float dist, int throttle, int turn) {
     full_state s{};
     s.distance_from_obstacle = dist;
@@ -0,0 +1,11 @@
+// checksum.h
+#ifndef CHECKSUM_H
+#define CHECKSUM_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Fletcher-16, used to validate records kept in EEPROM.
+uint16_t fletcher16(const uint8_t *data, size_t len);
+
+#endif
@@ -0,0 +1,9 @@
+// clamp.h
+#ifndef CLAMP_H
+#define CLAMP_H
+
+// Defined in rc_control.cpp; shared by the jitter buffer and the tests.
+int   clampInt(int val, int minVal, int maxVal);
+float clampFloat(float val, float minVal, float maxVal);
+
+#endif
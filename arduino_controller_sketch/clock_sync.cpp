@@ -0,0 +1,145 @@
+#include "clock_sync.h"
+#include "http_send.h"
+
+const int64_t RTT_SLACK_US    = 2000;   // accept up to 2x best RTT + slack
+const float   OFFSET_GAIN     = 0.25f;
+const float   SKEW_GAIN       = 0.125f;
+const float   MAX_SKEW_PPM    = 500.0f;
+const int64_t MIN_SKEW_SPAN_US = 1000000; // need >= 1s between samples
+
+clock_sync_state clockSync = {false, 0, 0, 0.0f, INT64_MAX, 0, 0};
+
+// micros() wraps every ~71 minutes; extend it to 64 bits.
+static uint32_t lastMicros = 0;
+static uint64_t microsHigh = 0;
+
+uint64_t clock_nowUs() {
+  uint32_t now = micros();
+  if (now < lastMicros) {
+    microsHigh += (1ULL << 32);
+  }
+  lastMicros = now;
+  return microsHigh | now;
+}
+
+void clockSyncInit(clock_sync_state &cs) {
+  cs.valid      = false;
+  cs.refLocalUs = 0;
+  cs.offsetUs   = 0;
+  cs.skewPpm    = 0.0f;
+  cs.minRttUs   = INT64_MAX;
+  cs.samples    = 0;
+  cs.rejected   = 0;
+}
+
+int64_t clockSyncToPhoneUs(const clock_sync_state &cs, uint64_t localUs) {
+  int64_t since = (int64_t)(localUs - cs.refLocalUs);
+  return (int64_t)localUs + cs.offsetUs + (int64_t)(since * (cs.skewPpm * 1e-6f));
+}
+
+bool clockSyncUpdate(clock_sync_state &cs,
+                     uint64_t atLocalUs,
+                     int64_t offsetUs,
+                     int64_t rttUs) {
+  if (rttUs < 0) {
+    cs.rejected++;
+    return false;
+  }
+
+  // Track the best round trip, letting it relax slowly if the path changes.
+  if (rttUs < cs.minRttUs) {
+    cs.minRttUs = rttUs;
+  } else {
+    cs.minRttUs += (rttUs - cs.minRttUs) / 32;
+  }
+
+  // Slow exchanges have asymmetric queueing; their offsets aren't worth it.
+  if (cs.valid && rttUs > 2 * cs.minRttUs + RTT_SLACK_US) {
+    cs.rejected++;
+    return false;
+  }
+
+  cs.samples++;
+  if (!cs.valid) {
+    cs.refLocalUs = atLocalUs;
+    cs.offsetUs   = offsetUs;
+    cs.skewPpm    = 0.0f;
+    cs.valid      = true;
+    return true;
+  }
+
+  int64_t span = (int64_t)(atLocalUs - cs.refLocalUs);
+  int64_t predicted = (int64_t)(clockSyncToPhoneUs(cs, atLocalUs) - (int64_t)atLocalUs);
+  int64_t err = offsetUs - predicted;
+
+  // Phase: move part way toward the measurement. Frequency: nudge skew by
+  // the error rate once samples are far enough apart to mean anything.
+  if (span >= MIN_SKEW_SPAN_US) {
+    float ppm = cs.skewPpm + SKEW_GAIN * ((float)err * 1e6f / (float)span);
+    if (ppm >  MAX_SKEW_PPM) ppm =  MAX_SKEW_PPM;
+    if (ppm < -MAX_SKEW_PPM) ppm = -MAX_SKEW_PPM;
+    cs.skewPpm = ppm;
+  }
+  cs.offsetUs   = predicted + (int64_t)(err * OFFSET_GAIN);
+  cs.refLocalUs = atLocalUs;
+  return true;
+}
+
+bool clock_toPhoneUs(uint64_t localUs, int64_t &phoneUs) {
+  if (!clockSync.valid) return false;
+  phoneUs = clockSyncToPhoneUs(clockSync, localUs);
+  return true;
+}
+
+void clock_loop() {
+  clock_nowUs();
+}
+
+static int64_t parseInt64(const char *s) {
+  bool neg = false;
+  if (*s == '-') { neg = true; s++; }
+  int64_t v = 0;
+  while (*s >= '0' && *s <= '9') {
+    v = v * 10 + (*s - '0');
+    s++;
+  }
+  return neg ? -v : v;
+}
+
+static bool findParam(const String &query, const char *name, int64_t &out) {
+  String key = String(name) + "=";
+  int idx = query.indexOf(key);
+  if (idx == -1) return false;
+  out = parseInt64(query.c_str() + idx + key.length());
+  return true;
+}
+
+// GET /time?t0=<phone us>[&off=<us>&rtt=<us>&at=<our t1 of that exchange>]
+void clock_handleRequest(const String &path, WiFiClient &client) {
+  uint64_t t1 = clock_nowUs();
+
+  int qIndex = path.indexOf('?');
+  String query = qIndex != -1 ? path.substring(qIndex + 1) : "";
+
+  int64_t t0 = 0, off = 0, rtt = 0, at = 0;
+  bool hasT0 = findParam(query, "t0", t0);
+  if (findParam(query, "off", off) &&
+      findParam(query, "rtt", rtt) &&
+      findParam(query, "at", at)) {
+    clockSyncUpdate(clockSync, (uint64_t)at, off, rtt);
+  }
+
+  http_response &r = respBegin();
+  jsonOpen(r, '{');
+  jsonKey(r, "t0");       jsonInt(r, hasT0 ? t0 : 0);
+  jsonKey(r, "t1");       jsonUInt(r, t1);
+  jsonKey(r, "synced");   jsonBool(r, clockSync.valid);
+  jsonKey(r, "offsetUs"); jsonInt(r, clockSync.offsetUs);
+  jsonKey(r, "skewPpm");  jsonFloat(r, clockSync.skewPpm, 2);
+  jsonKey(r, "samples");  jsonUInt(r, clockSync.samples);
+  jsonKey(r, "rejected"); jsonUInt(r, clockSync.rejected);
+  // Stamped as late as possible: nothing but the write itself follows.
+  jsonKey(r, "t2");       jsonUInt(r, clock_nowUs());
+  jsonClose(r, '}');
+  respSend(client, r, 200, "application/json");
+}
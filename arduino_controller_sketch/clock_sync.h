@@ -0,0 +1,41 @@
+// clock_sync.h
+#pragma once
+#include <WiFiS3.h>
+#include <stdint.h>
+
+// NTP-style offset/skew estimate against the phone's clock.
+//
+// The phone calls GET /time?t0=<phone us> and gets back our receive (t1)
+// and transmit (t2) times. From t0..t3 it computes offset and round trip
+// and hands them back on its next call (off=, rtt=, at=<that t1>), which
+// we fold into a small PLL so local timestamps can be mapped to phone time.
+typedef struct {
+  bool     valid;
+  uint64_t refLocalUs;   // local time the estimate is anchored at
+  int64_t  offsetUs;     // phone - local at refLocalUs
+  float    skewPpm;      // phone clock rate relative to ours
+  int64_t  minRttUs;     // best recent round trip, for outlier rejection
+  uint32_t samples;
+  uint32_t rejected;
+} clock_sync_state;
+
+void clockSyncInit(clock_sync_state &cs);
+
+// Fold in one exchange the phone measured. Returns false if rejected.
+bool clockSyncUpdate(clock_sync_state &cs,
+                     uint64_t atLocalUs,
+                     int64_t offsetUs,
+                     int64_t rttUs);
+
+// Map a local timestamp onto the phone's timeline.
+int64_t clockSyncToPhoneUs(const clock_sync_state &cs, uint64_t localUs);
+
+// 64-bit micros(); must be called at least once per ~71 minutes.
+uint64_t clock_nowUs();
+
+// A clock_nowUs() time on the phone's clock, from the estimate /time
+// maintains. False until the phone has sent a sample.
+bool clock_toPhoneUs(uint64_t localUs, int64_t &phoneUs);
+
+void clock_loop();
+void clock_handleRequest(const String &path, WiFiClient &client);
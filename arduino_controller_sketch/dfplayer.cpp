@@ -0,0 +1,165 @@
+// dfplayer.cpp
+#include "dfplayer.h"
+#include "dfplayer_protocol.h"
+
+const unsigned long DF_MIN_GAP_MS       = 30;  // player drops back-to-back frames
+const unsigned long DF_ACK_TIMEOUT_MS   = 100;
+const unsigned long DF_REPLY_TIMEOUT_MS = 200;
+const uint8_t       DF_MAX_RETRIES      = 2;
+
+typedef struct {
+  uint8_t cmd;
+  uint16_t param;
+  unsigned long delayMs;
+} df_command;
+
+static Stream *dfSerial = NULL;
+static df_listener dfListener = NULL;
+
+static df_command queue[DF_QUEUE_LEN];
+static int queueHead  = 0;
+static int queueCount = 0;
+
+// The command on the wire, kept until it's acknowledged (or answered, for
+// queries) so it can be resent.
+static bool inFlight = false;
+static df_command inFlightCmd;
+static uint8_t inFlightTries = 0;
+
+static unsigned long lastTxMs = 0;
+static unsigned long lastRxMs = 0;
+
+static df_parser parser;
+static df_stats stats;
+
+static bool isQuery(uint8_t cmd) {
+  return cmd >= DF_CMD_QUERY_STATUS;
+}
+
+// Resending these after a lost ACK would step or play twice if it was only
+// the ACK that got lost, so they go out once.
+static bool isRetryable(uint8_t cmd) {
+  return cmd != DF_CMD_NEXT && cmd != DF_CMD_PREVIOUS && cmd != DF_CMD_ADVERT;
+}
+
+static void transmit(const df_command &c) {
+  uint8_t frame[DF_FRAME_LEN];
+  // Queries are acknowledged by their reply; ask for an ACK on the rest.
+  dfEncodeFrame(frame, c.cmd, c.param, !isQuery(c.cmd));
+  dfSerial->write(frame, DF_FRAME_LEN);
+  stats.sent++;
+}
+
+static void handleFrame(const df_frame &f, unsigned long nowMs) {
+  lastRxMs = nowMs;
+
+  if (inFlight) {
+    bool done = isQuery(inFlightCmd.cmd) ? (f.cmd == inFlightCmd.cmd)
+                                         : (f.cmd == DF_MSG_ACK);
+    if (done || f.cmd == DF_MSG_ERROR) {
+      inFlight = false;
+    }
+    if (done && f.cmd == DF_MSG_ACK && dfListener) {
+      dfListener(DF_MSG_ACK, inFlightCmd.cmd);
+    }
+  }
+  if (dfListener && f.cmd != DF_MSG_ACK) {
+    dfListener(f.cmd, f.param);
+  }
+}
+
+void df_begin(Stream &serial, df_listener listener) {
+  dfSerial   = &serial;
+  dfListener = listener;
+  queueHead  = 0;
+  queueCount = 0;
+  inFlight   = false;
+  dfParserReset(parser);
+  stats = {0, 0, 0, 0};
+}
+
+bool df_send(uint8_t cmd, uint16_t param, unsigned long delayMs) {
+  if (queueCount == DF_QUEUE_LEN) {
+    return false;
+  }
+  int tail = (queueHead + queueCount) % DF_QUEUE_LEN;
+  queue[tail].cmd     = cmd;
+  queue[tail].param   = param;
+  queue[tail].delayMs = delayMs;
+  queueCount++;
+  return true;
+}
+
+bool df_sendUrgent(uint8_t cmd, uint16_t param) {
+  if (queueCount == DF_QUEUE_LEN) {
+    return false;
+  }
+  queueHead = (queueHead + DF_QUEUE_LEN - 1) % DF_QUEUE_LEN;
+  queue[queueHead].cmd     = cmd;
+  queue[queueHead].param   = param;
+  queue[queueHead].delayMs = 0;
+  queueCount++;
+  return true;
+}
+
+void df_poll(unsigned long nowMs) {
+  if (!dfSerial) return;
+
+  // Serial1 buffers received bytes from its RX interrupt; just drain them.
+  df_frame f;
+  while (dfSerial->available() > 0) {
+    if (dfParserFeed(parser, (uint8_t)dfSerial->read(), f)) {
+      handleFrame(f, nowMs);
+    }
+  }
+
+  if (inFlight) {
+    unsigned long timeout = isQuery(inFlightCmd.cmd) ? DF_REPLY_TIMEOUT_MS
+                                                     : DF_ACK_TIMEOUT_MS;
+    if (nowMs - lastTxMs <= timeout) {
+      return;
+    }
+    if (inFlightTries <= DF_MAX_RETRIES && isRetryable(inFlightCmd.cmd)) {
+      transmit(inFlightCmd);
+      inFlightTries++;
+      lastTxMs = nowMs;
+      stats.retries++;
+      return;
+    }
+    inFlight = false; // player isn't answering; give up on this one
+    stats.failed++;
+  }
+
+  if (queueCount == 0) {
+    return;
+  }
+
+  const df_command &next = queue[queueHead];
+  unsigned long gap = next.delayMs > DF_MIN_GAP_MS ? next.delayMs : DF_MIN_GAP_MS;
+  if (nowMs - lastTxMs < gap) {
+    return;
+  }
+
+  inFlightCmd   = next;
+  inFlightTries = 1;
+  inFlight      = true;
+  transmit(inFlightCmd);
+  lastTxMs = nowMs;
+
+  queueHead = (queueHead + 1) % DF_QUEUE_LEN;
+  queueCount--;
+}
+
+bool df_idle() {
+  return queueCount == 0 && !inFlight;
+}
+
+unsigned long df_lastRxMs() {
+  return lastRxMs;
+}
+
+df_stats df_getStats() {
+  df_stats s = stats;
+  s.badFrames = parser.badChecksum;
+  return s;
+}
@@ -0,0 +1,67 @@
+// dfplayer.h
+#pragma once
+#include <Arduino.h>
+
+// Non-blocking DFPlayer Mini driver: commands go into a small queue and are
+// paced out from df_poll(); replies are parsed a byte at a time and handed
+// to the listener, so nothing here waits on the serial link. Commands are
+// sent with an ACK request and resent if it doesn't arrive, except the
+// relative ones (next/previous/advert) that would act twice.
+
+// Commands we send
+#define DF_CMD_NEXT          0x01
+#define DF_CMD_PREVIOUS      0x02
+#define DF_CMD_PLAY_TRACK    0x03
+#define DF_CMD_VOLUME        0x06
+#define DF_CMD_RESET         0x0C
+#define DF_CMD_START         0x0D
+#define DF_CMD_PAUSE         0x0E
+#define DF_CMD_PLAY_FOLDER   0x0F // param = folder << 8 | file
+#define DF_CMD_ADVERT        0x13 // insert /ADVERT/NNNN.mp3, then resume
+#define DF_CMD_STOP_ADVERT   0x15
+#define DF_CMD_STOP          0x16
+#define DF_CMD_QUERY_STATUS  0x42
+#define DF_CMD_QUERY_VOLUME  0x43
+#define DF_CMD_QUERY_FILES   0x48
+#define DF_CMD_QUERY_TRACK   0x4C
+
+// Unsolicited messages from the player
+#define DF_MSG_TRACK_FINISHED 0x3D
+#define DF_MSG_INIT_DONE      0x3F
+#define DF_MSG_ERROR          0x40
+#define DF_MSG_ACK            0x41
+
+#define DF_QUEUE_LEN 8
+
+// Gets replies and player events. When a command is acknowledged the
+// listener sees (DF_MSG_ACK, acknowledged command).
+typedef void (*df_listener)(uint8_t cmd, uint16_t param);
+
+typedef struct {
+  unsigned long sent;      // frames written, including retries
+  unsigned long retries;
+  unsigned long failed;    // commands dropped after the last retry
+  unsigned long badFrames; // received frames with a bad checksum
+} df_stats;
+
+void df_begin(Stream &serial, df_listener listener);
+
+// Queue a command. delayMs holds it back that long after the previous
+// command went out (e.g. to let a track change settle before a query).
+// Returns false if the queue is full.
+bool df_send(uint8_t cmd, uint16_t param, unsigned long delayMs = 0);
+
+// Queue a command ahead of everything already waiting (but after the one
+// in flight). For cues that mustn't sit behind queries and track syncs.
+bool df_sendUrgent(uint8_t cmd, uint16_t param);
+
+// Drain received bytes and send the next queued command if it's due.
+void df_poll(unsigned long nowMs);
+
+// Nothing queued and no query waiting on a reply.
+bool df_idle();
+
+// millis() of the last valid frame from the player (0 if none yet).
+unsigned long df_lastRxMs();
+
+df_stats df_getStats();
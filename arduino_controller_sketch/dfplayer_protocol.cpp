@@ -0,0 +1,83 @@
+// dfplayer_protocol.cpp
+#include "dfplayer_protocol.h"
+
+static const uint8_t DF_START   = 0x7E;
+static const uint8_t DF_VERSION = 0xFF;
+static const uint8_t DF_LEN     = 0x06;
+static const uint8_t DF_END     = 0xEF;
+
+uint16_t dfChecksum(const uint8_t *frame) {
+  uint16_t sum = 0;
+  for (int i = 1; i < 7; i++) sum += frame[i];
+  return (uint16_t)(0 - sum);
+}
+
+void dfEncodeFrame(uint8_t out[DF_FRAME_LEN],
+                   uint8_t cmd,
+                   uint16_t param,
+                   bool wantAck) {
+  out[0] = DF_START;
+  out[1] = DF_VERSION;
+  out[2] = DF_LEN;
+  out[3] = cmd;
+  out[4] = wantAck ? 0x01 : 0x00;
+  out[5] = (uint8_t)(param >> 8);
+  out[6] = (uint8_t)(param & 0xFF);
+  uint16_t chk = dfChecksum(out);
+  out[7] = (uint8_t)(chk >> 8);
+  out[8] = (uint8_t)(chk & 0xFF);
+  out[9] = DF_END;
+}
+
+void dfParserReset(df_parser &p) {
+  p.pos         = 0;
+  p.badChecksum = 0;
+  p.badFraming  = 0;
+}
+
+// Drop the partial frame; a stray start byte begins the next one.
+static void resync(df_parser &p, uint8_t b) {
+  p.badFraming++;
+  if (b == DF_START) {
+    p.buf[0] = b;
+    p.pos = 1;
+  } else {
+    p.pos = 0;
+  }
+}
+
+bool dfParserFeed(df_parser &p, uint8_t b, df_frame &out) {
+  switch (p.pos) {
+    case 0:
+      if (b != DF_START) {
+        p.badFraming++;
+        return false;
+      }
+      break;
+    case 1:
+      if (b != DF_VERSION) { resync(p, b); return false; }
+      break;
+    case 2:
+      if (b != DF_LEN)     { resync(p, b); return false; }
+      break;
+    case DF_FRAME_LEN - 1: {
+      p.pos = 0;
+      if (b != DF_END) {
+        resync(p, b);
+        return false;
+      }
+      p.buf[DF_FRAME_LEN - 1] = b;
+      uint16_t chk = ((uint16_t)p.buf[7] << 8) | p.buf[8];
+      if (chk != dfChecksum(p.buf)) {
+        p.badChecksum++;
+        return false;
+      }
+      out.cmd      = p.buf[3];
+      out.feedback = p.buf[4];
+      out.param    = ((uint16_t)p.buf[5] << 8) | p.buf[6];
+      return true;
+    }
+  }
+  p.buf[p.pos++] = b;
+  return false;
+}
@@ -0,0 +1,41 @@
+// dfplayer_protocol.h
+#ifndef DFPLAYER_PROTOCOL_H
+#define DFPLAYER_PROTOCOL_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// DFPlayer Mini serial framing, with no Arduino dependencies so it can be
+// exercised on the host:
+//   7E FF 06 CMD FEEDBACK PARAM_H PARAM_L CHK_H CHK_L EF
+// where CHK = -(sum of bytes 1..6).
+
+#define DF_FRAME_LEN 10
+
+typedef struct {
+  uint8_t  cmd;
+  uint8_t  feedback;
+  uint16_t param;
+} df_frame;
+
+typedef struct {
+  uint8_t  buf[DF_FRAME_LEN];
+  uint8_t  pos;
+  uint32_t badChecksum; // complete frames dropped for a bad checksum
+  uint32_t badFraming;  // bytes discarded while resyncing
+} df_parser;
+
+uint16_t dfChecksum(const uint8_t *frame);
+
+void dfEncodeFrame(uint8_t out[DF_FRAME_LEN],
+                   uint8_t cmd,
+                   uint16_t param,
+                   bool wantAck);
+
+void dfParserReset(df_parser &p);
+
+// Feed one received byte. Returns true when it completes a valid frame,
+// which is written to out.
+bool dfParserFeed(df_parser &p, uint8_t b, df_frame &out);
+
+#endif
@@ -2,6 +2,11 @@
 #include <Arduino.h>   // for abs()
 #include "fsm.h"
 
+const int   THROTTLE_DEADZONE = 10;
+const int   TURN_DEADZONE     = 10;
+const float STOP_DISTANCE   = 20.0f; // stop if closer than this
+const float RESUME_DISTANCE = 25.0f; // only resume if farther than this
+
 full_state updateFSM(full_state currState,
                      int cmdThrottle,
                      int cmdTurn,
@@ -11,11 +16,6 @@ full_state updateFSM(full_state currState,
   // Update measured distance in state
   next.distance_from_obstacle = distanceCm;
 
-  const int   THROTTLE_DEADZONE = 10;
-  const int   TURN_DEADZONE     = 10;
-  const float STOP_DISTANCE   = 20.0f; // stop if closer than this
-  const float RESUME_DISTANCE = 25.0f; // only resume if farther than this
-
   switch (currState.state) {
     case s_IDLE:
       next.throttle = 0;
@@ -66,4 +66,20 @@ full_state updateFSM(full_state currState,
   }
   return next;
 
-}
\ No newline at end of file
+}
+
+fsm_event fsmEvent(full_state prevState,
+                   full_state nextState,
+                   int cmdThrottle) {
+  // Driving forward, still asked to, and the safety stop cut the throttle
+  if (prevState.throttle > THROTTLE_DEADZONE &&
+      nextState.throttle == 0 &&
+      cmdThrottle > THROTTLE_DEADZONE &&
+      nextState.distance_from_obstacle <= STOP_DISTANCE) {
+    return e_OBSTACLE_STOP;
+  }
+  if (prevState.state != nextState.state) {
+    return nextState.state == s_MOVE ? e_START : e_STOP;
+  }
+  return e_NONE;
+}
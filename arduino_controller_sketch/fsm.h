@@ -4,9 +4,21 @@
 
 #include "rc_car.h"
 
+typedef enum {
+  e_NONE          = 0,
+  e_OBSTACLE_STOP = 1, // forward throttle cut by the obstacle check
+  e_START         = 2, // IDLE -> MOVE
+  e_STOP          = 3, // MOVE -> IDLE
+} fsm_event;
+
 full_state updateFSM(full_state currState,
                      int cmdThrottle,
                      int cmdTurn,
                      float distanceCm);
 
+// What happened between two consecutive updateFSM() states.
+fsm_event fsmEvent(full_state prevState,
+                   full_state nextState,
+                   int cmdThrottle);
+
 #endif
\ No newline at end of file
@@ -0,0 +1,82 @@
+// test_dfplayer_protocol.cpp
+// Host build of the DFPlayer framing tests; dfplayer_protocol has no
+// Arduino dependencies. Run with: make -C host_tests
+#include <stdio.h>
+#include "dfplayer_protocol.h"
+
+static int failures = 0;
+
+static void assertEqualInt(const char *name, int expected, int actual) {
+  if (expected == actual) {
+    printf("PASSED: %s\n", name);
+  } else {
+    printf("FAILED: %s\n  expected=%d actual=%d\n", name, expected, actual);
+    failures++;
+  }
+}
+
+static int feedAll(df_parser &p, const uint8_t *bytes, int len, df_frame &f) {
+  int frames = 0;
+  for (int i = 0; i < len; i++) {
+    if (dfParserFeed(p, bytes[i], f)) frames++;
+  }
+  return frames;
+}
+
+static void testEncode() {
+  uint8_t frame[DF_FRAME_LEN];
+
+  // Play track 1: 7E FF 06 03 00 00 01 FE F7 EF
+  dfEncodeFrame(frame, 0x03, 1, false);
+  assertEqualInt("dfEncodeFrame start byte",      0x7E, frame[0]);
+  assertEqualInt("dfEncodeFrame no ack",          0x00, frame[4]);
+  assertEqualInt("dfEncodeFrame checksum high",   0xFE, frame[7]);
+  assertEqualInt("dfEncodeFrame checksum low",    0xF7, frame[8]);
+  assertEqualInt("dfEncodeFrame end byte",        0xEF, frame[9]);
+
+  dfEncodeFrame(frame, 0x06, 0x1234, true);
+  assertEqualInt("dfEncodeFrame ack requested",   0x01, frame[4]);
+  assertEqualInt("dfEncodeFrame param high",      0x12, frame[5]);
+  assertEqualInt("dfEncodeFrame param low",       0x34, frame[6]);
+}
+
+static void testParser() {
+  uint8_t frame[DF_FRAME_LEN];
+  df_parser p;
+  df_frame f = {0, 0, 0};
+  dfParserReset(p);
+
+  // Garbage, then a valid current-track reply (track 5)
+  uint8_t rx[] = {0x00, 0x7E, 0x12, 0x7E, 0xFF, 0x06, 0x4C, 0x00, 0x00, 0x05, 0xFE, 0xAA, 0xEF};
+  assertEqualInt("dfParser resyncs to one frame", 1, feedAll(p, rx, sizeof(rx), f));
+  assertEqualInt("dfParser reply cmd",   0x4C, f.cmd);
+  assertEqualInt("dfParser reply param", 5,    f.param);
+
+  // Round trip through the encoder, then corrupt the checksum
+  dfEncodeFrame(frame, 0x06, 20, true);
+  assertEqualInt("dfParser round trip", 1, feedAll(p, frame, DF_FRAME_LEN, f));
+  assertEqualInt("dfParser round trip param",    20, f.param);
+  assertEqualInt("dfParser round trip feedback", 1,  f.feedback);
+  frame[8] ^= 0x01;
+  assertEqualInt("dfParser rejects bad checksum", 0, feedAll(p, frame, DF_FRAME_LEN, f));
+  assertEqualInt("dfParser counts bad checksum",  1, (int)p.badChecksum);
+
+  // A wrong end byte drops the frame; the next good one still parses
+  dfEncodeFrame(frame, 0x4E, 42, false);
+  frame[9] = 0x00;
+  assertEqualInt("dfParser rejects bad end byte", 0, feedAll(p, frame, DF_FRAME_LEN, f));
+  frame[9] = 0xEF;
+  assertEqualInt("dfParser recovers after bad end", 1, feedAll(p, frame, DF_FRAME_LEN, f));
+  assertEqualInt("dfParser recovered param", 42, f.param);
+}
+
+int main() {
+  testEncode();
+  testParser();
+  if (failures) {
+    printf("%d DFPlayer protocol test(s) FAILED.\n", failures);
+    return 1;
+  }
+  printf("All DFPlayer protocol tests PASSED!\n");
+  return 0;
+}
@@ -0,0 +1,171 @@
+// http_response.cpp
+#include "http_response.h"
+#include <string.h>
+#include <stdio.h>
+
+static char* bodyStart(http_response &r) {
+  return r.buf + HTTP_HEADER_RESERVE;
+}
+
+void respReset(http_response &r) {
+  r.len = 0;
+  r.overflow = false;
+  r.needComma = false;
+}
+
+static void append(http_response &r, const char *s, size_t n) {
+  if (r.overflow) return;
+  if (r.len + n > HTTP_BODY_MAX) {
+    r.overflow = true;
+    return;
+  }
+  memcpy(bodyStart(r) + r.len, s, n);
+  r.len += n;
+}
+
+void respStr(http_response &r, const char *s) {
+  append(r, s, strlen(s));
+}
+
+void respChar(http_response &r, char c) {
+  append(r, &c, 1);
+}
+
+void respUInt(http_response &r, uint64_t v) {
+  char tmp[20];
+  int n = 0;
+  do {
+    tmp[n++] = (char)('0' + v % 10);
+    v /= 10;
+  } while (v);
+  char out[20];
+  for (int i = 0; i < n; i++) out[i] = tmp[n - 1 - i];
+  append(r, out, n);
+}
+
+void respInt(http_response &r, int64_t v) {
+  if (v < 0) {
+    respChar(r, '-');
+    respUInt(r, (uint64_t)0 - (uint64_t)v);
+  } else {
+    respUInt(r, (uint64_t)v);
+  }
+}
+
+void respFloat(http_response &r, float v, int decimals) {
+  if (v != v) { // NaN isn't valid JSON
+    respChar(r, '0');
+    return;
+  }
+  if (v < 0) {
+    respChar(r, '-');
+    v = -v;
+  }
+  uint32_t scale = 1;
+  for (int i = 0; i < decimals; i++) scale *= 10;
+  uint64_t fixed = (uint64_t)(v * scale + 0.5f);
+  respUInt(r, fixed / scale);
+  if (decimals > 0) {
+    respChar(r, '.');
+    uint64_t frac = fixed % scale;
+    for (uint32_t d = scale / 10; d > 0; d /= 10) {
+      respChar(r, (char)('0' + (frac / d) % 10));
+    }
+  }
+}
+
+static void separator(http_response &r) {
+  if (r.needComma) respChar(r, ',');
+  r.needComma = false;
+}
+
+void jsonOpen(http_response &r, char bracket) {
+  separator(r);
+  respChar(r, bracket);
+}
+
+void jsonClose(http_response &r, char bracket) {
+  respChar(r, bracket);
+  r.needComma = true;
+}
+
+void jsonKey(http_response &r, const char *key) {
+  separator(r);
+  respChar(r, '"');
+  respStr(r, key);
+  respStr(r, "\":");
+}
+
+void jsonInt(http_response &r, int64_t v) {
+  separator(r);
+  respInt(r, v);
+  r.needComma = true;
+}
+
+void jsonUInt(http_response &r, uint64_t v) {
+  separator(r);
+  respUInt(r, v);
+  r.needComma = true;
+}
+
+void jsonFloat(http_response &r, float v, int decimals) {
+  separator(r);
+  respFloat(r, v, decimals);
+  r.needComma = true;
+}
+
+void jsonBool(http_response &r, bool v) {
+  separator(r);
+  respStr(r, v ? "true" : "false");
+  r.needComma = true;
+}
+
+void jsonString(http_response &r, const char *s) {
+  separator(r);
+  respChar(r, '"');
+  for (; *s; s++) {
+    if (*s == '"' || *s == '\\') respChar(r, '\\');
+    respChar(r, *s);
+  }
+  respChar(r, '"');
+  r.needComma = true;
+}
+
+void jsonRaw(http_response &r, const char *json) {
+  separator(r);
+  respStr(r, json);
+  r.needComma = true;
+}
+
+static const char* statusText(int status) {
+  switch (status) {
+    case 200: return "OK";
+    case 400: return "Bad Request";
+    case 404: return "Not Found";
+    case 503: return "Service Unavailable";
+  }
+  return "Internal Server Error";
+}
+
+const char* respFinish(http_response &r, int status, const char *contentType, size_t &outLen) {
+  if (r.overflow) {
+    respReset(r);
+    respStr(r, "response too large");
+    status = 500;
+    contentType = "text/plain";
+  }
+
+  char header[HTTP_HEADER_RESERVE];
+  int n = snprintf(header, sizeof(header),
+                   "HTTP/1.1 %d %s\r\n"
+                   "Content-Type: %s\r\n"
+                   "Content-Length: %u\r\n"
+                   "Connection: close\r\n\r\n",
+                   status, statusText(status), contentType, (unsigned)r.len);
+  if (n < 0 || n >= (int)sizeof(header)) n = 0;
+
+  char *start = bodyStart(r) - n;
+  memcpy(start, header, n);
+  outLen = n + r.len;
+  return start;
+}
@@ -0,0 +1,49 @@
+// http_response.h
+#ifndef HTTP_RESPONSE_H
+#define HTTP_RESPONSE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+// Fixed-buffer HTTP response builder. The body is written straight into
+// the buffer behind room reserved for the headers; respFinish() then puts
+// the status line and headers (with Content-Length) in front of it, so the
+// whole response goes out in a single write with no heap allocation.
+
+#define HTTP_HEADER_RESERVE 128
+#define HTTP_BODY_MAX       1536
+
+typedef struct {
+  char buf[HTTP_HEADER_RESERVE + HTTP_BODY_MAX];
+  size_t len;       // body bytes written
+  bool overflow;    // body didn't fit; respFinish() turns it into a 500
+  bool needComma;   // JSON writer: next value/key needs a separator
+} http_response;
+
+void respReset(http_response &r);
+
+// Raw body writers
+void respStr(http_response &r, const char *s);
+void respChar(http_response &r, char c);
+void respInt(http_response &r, int64_t v);
+void respUInt(http_response &r, uint64_t v);
+void respFloat(http_response &r, float v, int decimals);
+
+// Minimal JSON writer: separators are inserted automatically, so a caller
+// only writes keys, values and brackets.
+void jsonOpen(http_response &r, char bracket);  // '{' or '['
+void jsonClose(http_response &r, char bracket); // '}' or ']'
+void jsonKey(http_response &r, const char *key);
+void jsonInt(http_response &r, int64_t v);
+void jsonUInt(http_response &r, uint64_t v);
+void jsonFloat(http_response &r, float v, int decimals);
+void jsonBool(http_response &r, bool v);
+void jsonString(http_response &r, const char *s);
+void jsonRaw(http_response &r, const char *json); // already-serialized value
+
+// Write the headers in front of the body. Returns the start of the full
+// response and sets outLen to its length.
+const char* respFinish(http_response &r, int status, const char *contentType, size_t &outLen);
+
+#endif
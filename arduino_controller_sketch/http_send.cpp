@@ -0,0 +1,26 @@
+// http_send.cpp
+#include "http_send.h"
+
+http_response httpResp;
+latency_stats httpLatency;
+
+http_response& respBegin() {
+  respReset(httpResp);
+  return httpResp;
+}
+
+void respSend(WiFiClient &client, http_response &r, int status, const char *contentType) {
+  size_t len = 0;
+  const char *out = respFinish(r, status, contentType, len);
+  client.write((const uint8_t*)out, len);
+}
+
+void jsonLatency(http_response &r, const latency_stats &st) {
+  jsonOpen(r, '{');
+  jsonKey(r, "count"); jsonUInt(r, st.count);
+  jsonKey(r, "p50");   jsonUInt(r, latPercentile(st, 50));
+  jsonKey(r, "p90");   jsonUInt(r, latPercentile(st, 90));
+  jsonKey(r, "p99");   jsonUInt(r, latPercentile(st, 99));
+  jsonKey(r, "max");   jsonUInt(r, st.maxValue);
+  jsonClose(r, '}');
+}
@@ -0,0 +1,18 @@
+// http_send.h
+#pragma once
+#include <WiFiS3.h>
+#include "http_response.h"
+#include "latency_stats.h"
+
+// The loop serves one request at a time, so handlers share one buffer.
+extern http_response httpResp;
+
+// Time from reading a request line to the response being handed to the
+// WiFi module, in microseconds.
+extern latency_stats httpLatency;
+
+http_response& respBegin();
+void respSend(WiFiClient &client, http_response &r, int status, const char *contentType);
+
+// {"count","p50","p90","p99","max"} for a latency histogram.
+void jsonLatency(http_response &r, const latency_stats &st);
@@ -0,0 +1,154 @@
+// jitter_buffer.cpp
+#include <Arduino.h>
+#include "jitter_buffer.h"
+#include "clamp.h"
+
+const unsigned long JB_MAX_DELAY_MS  = 120; // never hold commands longer
+const unsigned long JB_HORIZON_MS    = 150; // max extrapolation past newest
+const unsigned long JB_MAX_SPAN_MS   = 300; // don't extrapolate across gaps this big
+const float         JB_JITTER_GAIN   = 1.0f / 16.0f;
+const float         JB_DELAY_PER_JIT = 2.0f;
+const long          JB_OFFSET_CREEP  = 256; // offset drifts up by 1/256 per push
+
+void jbReset(jitter_buffer &jb) {
+  jb.count         = 0;
+  jb.synced        = false;
+  jb.offsetMs      = 0;
+  jb.lastTransitMs = 0;
+  jb.jitterMs      = 0.0f;
+  jb.delayMs       = 0;
+  jb.extrapolating = false;
+}
+
+void jbFlush(jitter_buffer &jb) {
+  jb.count         = 0;
+  jb.extrapolating = false;
+}
+
+void jbPush(jitter_buffer &jb,
+            unsigned long clientMs,
+            int throttle,
+            int turn,
+            unsigned long nowMs) {
+  // Transit = one-way delay + clock offset. Differences stay valid across
+  // millis() wrap because both clocks are unsigned 32-bit.
+  long transit = (long)(nowMs - clientMs);
+
+  if (!jb.synced) {
+    jb.offsetMs      = transit;
+    jb.lastTransitMs = transit;
+    jb.synced        = true;
+  } else {
+    long d = transit - jb.lastTransitMs;
+    if (d < 0) d = -d;
+    jb.jitterMs += ((float)d - jb.jitterMs) * JB_JITTER_GAIN;
+    jb.lastTransitMs = transit;
+
+    // Follow the fastest packet down immediately, creep up slowly so
+    // clock skew between phone and controller doesn't accumulate.
+    if (transit < jb.offsetMs) {
+      jb.offsetMs = transit;
+    } else {
+      jb.offsetMs += (transit - jb.offsetMs + JB_OFFSET_CREEP - 1) / JB_OFFSET_CREEP;
+    }
+  }
+
+  unsigned long playout = (unsigned long)(jb.jitterMs * JB_DELAY_PER_JIT);
+  jb.delayMs = playout > JB_MAX_DELAY_MS ? JB_MAX_DELAY_MS : playout;
+
+  // Insert in clientMs order; replace duplicates, drop the oldest if full.
+  int pos = jb.count;
+  while (pos > 0 && (long)(jb.slots[pos - 1].clientMs - clientMs) > 0) {
+    pos--;
+  }
+  if (pos > 0 && jb.slots[pos - 1].clientMs == clientMs) {
+    jb.slots[pos - 1].throttle = throttle;
+    jb.slots[pos - 1].turn     = turn;
+    return;
+  }
+  if (jb.count == JB_SLOTS) {
+    if (pos == 0) return; // older than everything we hold
+    for (int i = 1; i < jb.count; i++) jb.slots[i - 1] = jb.slots[i];
+    jb.count--;
+    pos--;
+  }
+  for (int i = jb.count; i > pos; i--) jb.slots[i] = jb.slots[i - 1];
+  jb.slots[pos].clientMs = clientMs;
+  jb.slots[pos].throttle = throttle;
+  jb.slots[pos].turn     = turn;
+  jb.count++;
+}
+
+static int lerpCmd(int a, int b, long num, long den) {
+  if (den <= 0) return b;
+  return clampInt(a + (int)((long)(b - a) * num / den), -255, 255);
+}
+
+// Like lerpCmd past b, but never lets a trend carry the command through
+// zero (e.g. a slowdown must not extrapolate into reverse).
+static int extrapCmd(int a, int b, long num, long den) {
+  int v = lerpCmd(a, b, den + num, den);
+  if (b == 0 || (b > 0 && v < 0) || (b < 0 && v > 0)) return 0;
+  return v;
+}
+
+bool jbPlayout(jitter_buffer &jb,
+               unsigned long nowMs,
+               int &throttle,
+               int &turn) {
+  if (jb.count == 0) {
+    return false;
+  }
+
+  // The point on the phone's timeline we should be replaying right now.
+  unsigned long target = nowMs - (unsigned long)jb.offsetMs - jb.delayMs;
+
+  // Drop samples we've played past, but keep the newest two around so a
+  // gap after them can be extrapolated.
+  while (jb.count >= 3 && (long)(target - jb.slots[1].clientMs) >= 0) {
+    for (int i = 1; i < jb.count; i++) jb.slots[i - 1] = jb.slots[i];
+    jb.count--;
+  }
+
+  const jb_sample &a = jb.slots[0];
+  jb.extrapolating = false;
+
+  if (jb.count == 1 || (long)(target - a.clientMs) <= 0) {
+    throttle = a.throttle;
+    turn     = a.turn;
+    return true;
+  }
+
+  const jb_sample &b = jb.slots[1];
+  long span = (long)(b.clientMs - a.clientMs);
+  long into = (long)(target - a.clientMs);
+
+  if (into < span) {
+    // a <= target < b: interpolate.
+    throttle = lerpCmd(a.throttle, b.throttle, into, span);
+    turn     = lerpCmd(a.turn,     b.turn,     into, span);
+    return true;
+  }
+
+  // Past the newest sample: continue the last trend for a short horizon,
+  // then hold. Gaps that are already long aren't worth extrapolating.
+  long past = into - span;
+  if (span > (long)JB_MAX_SPAN_MS) {
+    throttle = b.throttle;
+    turn     = b.turn;
+    return true;
+  }
+  if (past > (long)JB_HORIZON_MS) past = JB_HORIZON_MS;
+
+  jb.extrapolating = true;
+  throttle = extrapCmd(a.throttle, b.throttle, past, span);
+  turn     = lerpCmd(a.turn, b.turn, span + past, span);
+  return true;
+}
+
+bool jbPlayedThrough(const jitter_buffer &jb,
+                     unsigned long nowMs,
+                     unsigned long clientMs) {
+  unsigned long target = nowMs - (unsigned long)jb.offsetMs - jb.delayMs;
+  return jb.count == 0 || (long)(target - clientMs) >= 0;
+}
@@ -0,0 +1,47 @@
+// jitter_buffer.h
+#ifndef JITTER_BUFFER_H
+#define JITTER_BUFFER_H
+
+#define JB_SLOTS 8
+
+typedef struct {
+  unsigned long clientMs; // phone clock when the command was sent
+  int throttle;
+  int turn;
+} jb_sample;
+
+typedef struct {
+  jb_sample slots[JB_SLOTS]; // ordered by clientMs, oldest first
+  int   count;
+  bool  synced;              // offsetMs / lastTransitMs are valid
+  long  offsetMs;            // local - client, tracks the fastest transit
+  long  lastTransitMs;
+  float jitterMs;            // smoothed transit variation
+  unsigned long delayMs;     // adaptive playout delay on top of offsetMs
+  bool  extrapolating;       // last playout ran past the newest sample
+} jitter_buffer;
+
+void jbReset(jitter_buffer &jb);
+
+// Drop queued commands but keep the clock/jitter estimates.
+void jbFlush(jitter_buffer &jb);
+
+// Queue a command stamped with the phone's clock.
+void jbPush(jitter_buffer &jb,
+            unsigned long clientMs,
+            int throttle,
+            int turn,
+            unsigned long nowMs);
+
+// Sample the command stream for this tick. Returns false if empty.
+bool jbPlayout(jitter_buffer &jb,
+               unsigned long nowMs,
+               int &throttle,
+               int &turn);
+
+// True once playout has reached the given phone timestamp.
+bool jbPlayedThrough(const jitter_buffer &jb,
+                     unsigned long nowMs,
+                     unsigned long clientMs);
+
+#endif
@@ -0,0 +1,39 @@
+// latency_stats.cpp
+#include "latency_stats.h"
+
+void latInit(latency_stats &st, unsigned long bucketWidth) {
+  st.bucketWidth = bucketWidth ? bucketWidth : 1;
+  for (int i = 0; i < LAT_BUCKETS; i++) st.counts[i] = 0;
+  st.overflow = 0;
+  st.count    = 0;
+  st.maxValue = 0;
+}
+
+void latRecord(latency_stats &st, unsigned long value) {
+  unsigned long idx = value / st.bucketWidth;
+  if (idx < LAT_BUCKETS) {
+    st.counts[idx]++;
+  } else {
+    st.overflow++;
+  }
+  st.count++;
+  if (value > st.maxValue) st.maxValue = value;
+}
+
+unsigned long latPercentile(const latency_stats &st, int pct) {
+  if (st.count == 0) return 0;
+
+  // Rank of the sample we want, rounded up so p100 is the last one.
+  unsigned long rank = (st.count * (unsigned long)pct + 99) / 100;
+  if (rank == 0) rank = 1;
+
+  unsigned long seen = 0;
+  for (int i = 0; i < LAT_BUCKETS; i++) {
+    seen += st.counts[i];
+    if (seen >= rank) {
+      unsigned long edge = (i + 1) * st.bucketWidth;
+      return edge < st.maxValue ? edge : st.maxValue;
+    }
+  }
+  return st.maxValue;
+}
@@ -0,0 +1,23 @@
+// latency_stats.h
+#ifndef LATENCY_STATS_H
+#define LATENCY_STATS_H
+
+#define LAT_BUCKETS 40
+
+// Fixed-width histogram, cheap enough to update from the control loop.
+typedef struct {
+  unsigned long bucketWidth;          // units per bucket (ms or us)
+  unsigned long counts[LAT_BUCKETS];
+  unsigned long overflow;             // samples past the last bucket
+  unsigned long count;
+  unsigned long maxValue;
+} latency_stats;
+
+void latInit(latency_stats &st, unsigned long bucketWidth);
+void latRecord(latency_stats &st, unsigned long value);
+
+// Upper edge of the bucket holding the given percentile (0..100).
+// Returns maxValue if it lands in the overflow bucket.
+unsigned long latPercentile(const latency_stats &st, int pct);
+
+#endif
@@ -0,0 +1,129 @@
+// link_governor.cpp
+#include <Arduino.h>   // for abs()
+#include "link_governor.h"
+
+// Throttle cap vs. link delay score, linearly interpolated between points.
+// Score is the smoothed jitter plus however late the current command is
+// compared to the usual inter-arrival time.
+typedef struct {
+  float scoreMs;
+  int   cap;
+} gov_point;
+
+static const gov_point GOV_CURVE[] = {
+  {  30.0f, 255 },
+  {  80.0f, 200 },
+  { 150.0f, 140 },
+  { 250.0f,  90 },
+};
+static const int GOV_CURVE_LEN = sizeof(GOV_CURVE) / sizeof(GOV_CURVE[0]);
+
+const unsigned long LINK_DEADLINE_MS = 500;   // silence before we stop
+const float         STOP_RAMP_PER_MS = 0.8f;  // 255 -> 0 in ~320ms
+const float         INTERVAL_GAIN    = 1.0f / 8.0f;
+const float         JITTER_GAIN      = 1.0f / 16.0f; // RFC 3550 style
+const int           DEGRADED_CAP     = 200;  // caps below this report DEGRADED
+
+link_state initLinkGovernor(unsigned long nowMs) {
+  link_state s;
+  s.lastCmdMs    = nowMs;
+  s.lastUpdateMs = nowMs;
+  s.cmdCount     = 0;
+  s.intervalMs   = 0.0f;
+  s.jitterMs     = 0.0f;
+  s.throttleCap  = 0;
+  s.outThrottle  = 0;
+  s.mode         = l_NO_LINK;
+  return s;
+}
+
+int linkThrottleCap(float scoreMs) {
+  if (scoreMs <= GOV_CURVE[0].scoreMs) {
+    return GOV_CURVE[0].cap;
+  }
+  for (int i = 1; i < GOV_CURVE_LEN; i++) {
+    if (scoreMs <= GOV_CURVE[i].scoreMs) {
+      const gov_point &a = GOV_CURVE[i - 1];
+      const gov_point &b = GOV_CURVE[i];
+      float t = (scoreMs - a.scoreMs) / (b.scoreMs - a.scoreMs);
+      return a.cap + (int)((b.cap - a.cap) * t);
+    }
+  }
+  return GOV_CURVE[GOV_CURVE_LEN - 1].cap;
+}
+
+link_state linkOnCommand(link_state currState, unsigned long nowMs) {
+  link_state next = currState;
+
+  if (currState.cmdCount > 0) {
+    float interval = (float)(nowMs - currState.lastCmdMs);
+    if (currState.cmdCount == 1) {
+      next.intervalMs = interval;
+    } else {
+      float dev = interval - currState.intervalMs;
+      if (dev < 0) dev = -dev;
+      next.jitterMs   += (dev - currState.jitterMs) * JITTER_GAIN;
+      next.intervalMs += (interval - currState.intervalMs) * INTERVAL_GAIN;
+    }
+  }
+
+  next.lastCmdMs = nowMs;
+  next.cmdCount  = currState.cmdCount + 1;
+  return next;
+}
+
+link_state updateLinkGovernor(link_state currState,
+                              int cmdThrottle,
+                              unsigned long nowMs) {
+  link_state next = currState;
+  next.lastUpdateMs = nowMs;
+
+  if (currState.cmdCount == 0) {
+    next.mode        = l_NO_LINK;
+    next.throttleCap = 0;
+    next.outThrottle = 0;
+    return next;
+  }
+
+  unsigned long silentMs = nowMs - currState.lastCmdMs;
+
+  if (silentMs > LINK_DEADLINE_MS) {
+    // Link went quiet: ramp whatever we were doing down to a stop.
+    unsigned long dt = nowMs - currState.lastUpdateMs;
+    int step = (int)(dt * STOP_RAMP_PER_MS) + 1;
+    int out  = currState.outThrottle;
+    if (abs(out) <= step) {
+      out = 0;
+    } else {
+      out += (out > 0) ? -step : step;
+    }
+    next.mode        = l_LOST;
+    next.throttleCap = abs(out);
+    next.outThrottle = out;
+    return next;
+  }
+
+  float lateMs = (float)silentMs - currState.intervalMs;
+  if (lateMs < 0) lateMs = 0;
+
+  int cap = linkThrottleCap(currState.jitterMs + lateMs);
+
+  int out = cmdThrottle;
+  if (out >  cap) out =  cap;
+  if (out < -cap) out = -cap;
+
+  next.mode        = (cap < DEGRADED_CAP) ? l_DEGRADED : l_OK;
+  next.throttleCap = cap;
+  next.outThrottle = out;
+  return next;
+}
+
+const char* linkModeToStr(link_mode m) {
+  switch (m) {
+    case l_NO_LINK:  return "NO_LINK";
+    case l_OK:       return "OK";
+    case l_DEGRADED: return "DEGRADED";
+    case l_LOST:     return "LOST";
+    default:         return "UNKNOWN";
+  }
+}
@@ -0,0 +1,38 @@
+// link_governor.h
+#ifndef LINK_GOVERNOR_H
+#define LINK_GOVERNOR_H
+
+typedef enum {
+  l_NO_LINK  = 0, // no /drive command seen yet
+  l_OK       = 1,
+  l_DEGRADED = 2, // jittery or late commands, throttle capped
+  l_LOST     = 3, // silent past the deadline, ramping to a stop
+} link_mode;
+
+typedef struct {
+  unsigned long lastCmdMs;    // millis() of the last /drive command
+  unsigned long lastUpdateMs; // millis() of the last governor update
+  unsigned long cmdCount;
+  float intervalMs;           // smoothed command inter-arrival time
+  float jitterMs;             // smoothed |interval - intervalMs|
+  int   throttleCap;          // max |throttle| allowed right now
+  int   outThrottle;          // governed throttle handed to the FSM
+  link_mode mode;
+} link_state;
+
+link_state initLinkGovernor(unsigned long nowMs);
+
+// Call once for every command that arrives from the app.
+link_state linkOnCommand(link_state currState, unsigned long nowMs);
+
+// Call once per control loop tick with the latest requested throttle.
+link_state updateLinkGovernor(link_state currState,
+                              int cmdThrottle,
+                              unsigned long nowMs);
+
+// Throttle cap for a given link delay score (jitter + excess silence).
+int linkThrottleCap(float scoreMs);
+
+const char* linkModeToStr(link_mode m);
+
+#endif
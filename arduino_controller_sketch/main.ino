@@ -1,50 +1,147 @@
 #include <WiFiS3.h>
 #include "mp3.h"
 #include "rc_control.h"
+#include "clock_sync.h"
+#include "http_send.h"
+#include "wifi_manager.h"
 
 const char* ssid = "Verizon_FYCW9R";
 const char* password = "mavis4-dun-fax";
 
 WiFiServer server(8080);
 
-void setup() {
-    Serial.begin(9600);
+// Boot phase timestamps, millis() since power-on. The DFPlayer comes up in
+// the background and reports its own time via mp3_playerReadyMs().
+unsigned long bootCarReadyMs  = 0;
+unsigned long bootWifiReadyMs = 0;
+unsigned long bootSetupDoneMs = 0;
+
+void printBootPhase(const char* phase, unsigned long ms) {
+    Serial.print("[BOOT] ");
+    Serial.print(phase);
+    Serial.print(" at ");
+    Serial.print(ms);
+    Serial.println(" ms");
+}
+
+void sendBootReport(WiFiClient &client) {
+    http_response &r = respBegin();
+    jsonOpen(r, '{');
+    jsonKey(r, "carReadyMs");  jsonUInt(r, bootCarReadyMs);
+    jsonKey(r, "wifiReadyMs"); jsonUInt(r, bootWifiReadyMs);
+    jsonKey(r, "setupDoneMs"); jsonUInt(r, bootSetupDoneMs);
+    jsonKey(r, "mp3ReadyMs");  jsonUInt(r, mp3_playerReadyMs());
+    jsonKey(r, "mp3State");    jsonString(r, mp3_playerStateStr());
 
-    // Connect WiFi
-    WiFi.begin(ssid, password);
-    while (WiFi.status() != WL_CONNECTED) {
-        delay(500);
-        Serial.print(".");
+    wifi_stats ws = wifi_getStats();
+    jsonKey(r, "wifi");
+    jsonOpen(r, '{');
+    jsonKey(r, "state");         jsonString(r, wifiStateToStr(ws.state));
+    jsonKey(r, "lastConnectMs"); jsonUInt(r, ws.lastConnectMs);
+    jsonKey(r, "usedCache");     jsonBool(r, ws.usedCache);
+    jsonKey(r, "cacheRejects");  jsonUInt(r, ws.cacheRejects);
+    jsonKey(r, "dhcpStuck");     jsonBool(r, ws.dhcpStuck);
+    jsonKey(r, "connects");      jsonUInt(r, ws.connects);
+    jsonKey(r, "reconnects");    jsonUInt(r, ws.reconnects);
+    jsonKey(r, "failures");      jsonUInt(r, ws.failures);
+    jsonClose(r, '}');
+    jsonClose(r, '}');
+    respSend(client, r, 200, "application/json");
+}
+
+// GET /state[?ud=&lr=&t=&seq=][&cmd=|&volume=|&track=]
+// One round trip for the phone: applies an optional drive command and an
+// optional MP3 command, then returns the car state and player status.
+void handleStateRequest(const String &path, WiFiClient &client) {
+    int q = path.indexOf('?');
+    String query = (q != -1 ? path.substring(q + 1) : "");
+
+    bool hasDrive = query.indexOf("ud=") != -1 || query.indexOf("lr=") != -1;
+    drive_echo echo;
+    if (hasDrive) car_applyDrive(query, echo);
+    mp3_cmd_result mp3Result = mp3_applyCommand(query);
+
+    http_response &r = respBegin();
+    jsonOpen(r, '{');
+    jsonKey(r, "car"); car_writeState(r);
+    if (hasDrive) {
+        jsonKey(r, "drive"); car_writeDriveEcho(r, echo);
     }
-    Serial.println("MAIN YIPPEE");
-    Serial.println("\nWiFi connected. IP:");
-    Serial.println(WiFi.localIP());
+    jsonKey(r, "mp3"); mp3_writeStatus(r);
+    if (mp3Result != MP3_CMD_NONE) {
+        jsonKey(r, "mp3Cmd");
+        jsonString(r, mp3Result == MP3_CMD_APPLIED ? "applied" : "not_ready");
+    }
+    jsonClose(r, '}');
+    respSend(client, r, 200, "application/json");
+}
 
-    server.begin();
+void setup() {
+    Serial.begin(9600);
+    // 5 ms buckets cover 0-200 ms: a reply is several modem writes, so
+    // requests routinely run past the 20 ms that 500 us buckets reached.
+    latInit(httpLatency, 5000);
 
-    // Initialize modules
-    mp3_init();
+    // Motors off and steering centred before anything that can take time.
     car_init();
+    bootCarReadyMs = millis();
+    printBootPhase("car ready", bootCarReadyMs);
+
+    // Only opens the UART; the DFPlayer handshake runs from mp3_loop.
+    mp3_init();
+
+    // Starts association and returns; wifi_loop() finishes it. Nothing in
+    // setup() blocks for long any more, so the watchdog can run from here.
+    wifi_begin(ssid, password);
+    car_startWatchdog();
+    bootSetupDoneMs = millis();
+    printBootPhase("setup done", bootSetupDoneMs);
 }
 
 void loop() {
-    WiFiClient client = server.available();
+    wifi_loop();
+    if (wifi_justConnected()) {
+        // The listening socket lives on the WiFi module; reopen it after
+        // every (re)association.
+        server.begin();
+        if (bootWifiReadyMs == 0) {
+            bootWifiReadyMs = millis();
+            printBootPhase("wifi ready", bootWifiReadyMs);
+        }
+        Serial.print("WiFi connected. IP: ");
+        Serial.println(WiFi.localIP());
+    }
+
+    // No link: nothing can be steering the car, so hold it stopped.
+    if (!wifi_connected()) {
+        car_holdStopped();
+    }
+
+    WiFiClient client = wifi_connected() ? server.available() : WiFiClient();
     if (client) {
         String line = client.readStringUntil('\r');
         while (client.available()) client.read();
 
+        unsigned long reqStartUs = micros();
+        bool parked = false;
         int start = line.indexOf("GET ");
         int end   = line.indexOf(" HTTP/");
         if (start != -1 && end != -1) {
             String path = line.substring(start + 4, end);
 
-            if (path.startsWith("/mp3"))  mp3_handleRequest(path, client);
-            if (path.startsWith("/drive")) car_handleRequest(path, client);
+            if (path.startsWith("/mp3"))  parked = mp3_handleRequest(path, client);
+            if (path.startsWith("/drive") ||
+                path.startsWith("/telemetry")) car_handleRequest(path, client);
+            if (path.startsWith("/time"))  clock_handleRequest(path, client);
+            if (path.startsWith("/boot"))  sendBootReport(client);
+            if (path.startsWith("/state")) handleStateRequest(path, client);
         }
-        client.stop();
+        if (!parked) client.stop();
+        latRecord(httpLatency, micros() - reqStartUs);
     }
 
     // Run module loops
+    clock_loop();
     mp3_loop();
     car_loop();
 }
@@ -1,6 +1,12 @@
 #include <WiFiS3.h>
-#include "SoftwareSerial.h"
-#include "DFRobotDFPlayerMini.h"
+#include "mp3.h"
+#include "dfplayer.h"
+#include "buttons.h"
+#include "track_catalog.h"
+#include "http_send.h"
+#include "sound_cues.h"
+#include "latency_stats.h"
+#include <EEPROM.h>
 
 // WiFi credentials
 // const char* ssid     = "Anika-iPhone";
@@ -8,31 +14,30 @@
 // const char* ssid     =  "Verizon_FYCW9R"; //"Brown Bear";
 // const char* password =  "mavis4-dun-fax"; //BbBbWDYS?3";
 
-// pins 2 and 3 to communicate with DFPlayer 
-static const uint8_t PIN_MP3_TX = 6; // Arduino → DFPlayer RX
-static const uint8_t PIN_MP3_RX = 3; // DFPlayer TX → Arduino
-SoftwareSerial softwareSerial(PIN_MP3_RX, PIN_MP3_TX);
-
-// Create player object
-DFRobotDFPlayerMini player;
+// DFPlayer on the hardware UART (Serial1): D1 (TX) → DFPlayer RX,
+// DFPlayer TX → D0 (RX). Unlike SoftwareSerial this never masks interrupts,
+// so the ultrasonic echo ISR keeps accurate timing.
+#define mp3Serial Serial1
 
 // BUTTONS
-const int BTN_PLAY = 4;
-const int BTN_NEXT = 5;
-const int BTN_PREV = 13;
+// All on interrupt-capable pins (D4/D5 have none on the UNO R4); D3 was
+// freed when the DFPlayer moved to Serial1.
+const uint8_t BTN_PLAY = 3;
+const uint8_t BTN_NEXT = A1;
+const uint8_t BTN_PREV = 13;
+
+enum { BUTTON_PLAY = 0, BUTTON_NEXT = 1, BUTTON_PREV = 2 };
+const uint8_t BUTTON_PINS[] = { BTN_PLAY, BTN_NEXT, BTN_PREV };
 
 // WiFi server
 // WiFiServer server(8080);
 
-// Simple debounce
-unsigned long lastPress = 0;
-const unsigned long debounceDelay = 250;
-
 bool isPaused = true;
 int currentVolume = 15;
 int currentTrack = 1;
 
-// Track names (index = track number - 1)
+// Known track names (index = track number - 1). The track count comes from
+// the SD card via the catalog; tracks past this table are "Track N".
 const char* TRACK_NAMES[] = {
   "deep in it by berlioz",
   "I Am in Love by Jennifer Lara",
@@ -43,7 +48,81 @@ const char* TRACK_NAMES[] = {
   "Where Are You 54 Ultra"
 };
 
-const int MAX_TRACKS = sizeof(TRACK_NAMES) / sizeof(TRACK_NAMES[0]);
+const int BUILTIN_TRACKS = sizeof(TRACK_NAMES) / sizeof(TRACK_NAMES[0]);
+
+int trackCount = BUILTIN_TRACKS;
+bool catalogFromFlash = false;
+
+void mp3_onPlayerMessage(uint8_t cmd, uint16_t param);
+
+// DFPlayer bring-up runs from mp3_loop so setup() never waits on it. The
+// player is probed until it answers; after PLAYER_BOOT_TIMEOUT_MS it's
+// reported absent and probed at a slower rate in case it shows up later.
+typedef enum {
+  p_STARTING = 0,
+  p_READY    = 1,
+  p_ABSENT   = 2,
+} player_state;
+
+const unsigned long PLAYER_PROBE_MS        = 500;
+const unsigned long PLAYER_BOOT_TIMEOUT_MS = 5000;
+const unsigned long PLAYER_RETRY_MS        = 10000;
+
+player_state playerState = p_STARTING;
+unsigned long playerStartMs = 0;
+unsigned long playerProbeMs = 0;
+unsigned long playerReadyMs = 0;
+
+// Sound cues (see sound_cues.h). A cue is inserted as an ADVERT clip and
+// the player resumes the song where it was by itself. Adverts are refused
+// while paused, and playing the clip as a normal file would replace the
+// paused track and lose its position, so cues are dropped until the music
+// is playing again.
+cue_queue cues;
+latency_stats cueAckLatency; // trigger -> player ACKed the advert, ms
+bool cueAwaitingAck = false;
+
+
+// ---------------------------------------------------------------------------------------------
+// TRACK CATALOG
+// ---------------------------------------------------------------------------------------------
+// Use the count saved by an earlier boot so the catalog is right before the
+// player has answered. Falls back to the built-in table if there's none.
+void loadCatalog() {
+    track_catalog rec;
+    EEPROM.get(CATALOG_EEPROM_ADDR, rec);
+    if (catalogValid(rec)) {
+        trackCount = rec.trackCount;
+        catalogFromFlash = true;
+    }
+}
+
+// Called with the player's file count; only writes flash when it changed.
+// Zero means the card isn't mounted (or the player answered early), so it
+// neither replaces the known count nor gets saved.
+void updateCatalog(uint16_t files) {
+    if (files == 0) return;
+    if (files > CATALOG_MAX_TRACKS) files = CATALOG_MAX_TRACKS;
+    if (catalogFromFlash && files == trackCount) return;
+
+    track_catalog rec;
+    catalogMake(rec, files);
+    EEPROM.put(CATALOG_EEPROM_ADDR, rec);
+    trackCount = files;
+    catalogFromFlash = true;
+
+    Serial.print("[MP3] Catalog: ");
+    Serial.print(trackCount);
+    Serial.println(" tracks");
+}
+
+const char* trackName(int n) {
+    static char generic[20];
+    if (n < 1 || n > trackCount) return "Unknown";
+    if (n <= BUILTIN_TRACKS) return TRACK_NAMES[n - 1];
+    snprintf(generic, sizeof(generic), "Track %d", n);
+    return generic;
+}
 
 
 // ---------------------------------------------------------------------------------------------
@@ -52,20 +131,65 @@ const int MAX_TRACKS = sizeof(TRACK_NAMES) / sizeof(TRACK_NAMES[0]);
 void mp3_init() {
     Serial.println("Initializing MP3 subsystem...");
 
-    softwareSerial.begin(9600);
+    mp3Serial.begin(9600);
+
+    buttons_begin(BUTTON_PINS, sizeof(BUTTON_PINS));
+
+    loadCatalog();
+
+    df_begin(mp3Serial, mp3_onPlayerMessage);
+    cueInit(cues);
+    latInit(cueAckLatency, 5);
+    isPaused = true;
+    playerState   = p_STARTING;
+    playerStartMs = millis();
+    playerProbeMs = 0;
+}
+
+unsigned long mp3_playerReadyMs() {
+    return playerReadyMs;
+}
 
-    pinMode(BTN_PLAY, INPUT_PULLUP);
-    pinMode(BTN_NEXT, INPUT_PULLUP);
-    pinMode(BTN_PREV, INPUT_PULLUP);
+const char* mp3_playerStateStr() {
+    switch (playerState) {
+        case p_STARTING: return "STARTING";
+        case p_READY:    return "READY";
+        case p_ABSENT:   return "ABSENT";
+    }
+    return "UNKNOWN";
+}
 
-    if (player.begin(softwareSerial)) {
-        Serial.println("DFPlayer OK");
-        player.volume(currentVolume);
-        player.play(1);
-        player.pause();
+void servicePlayerBringUp(unsigned long now) {
+    if (playerState == p_READY) return;
+
+    if (df_lastRxMs() != 0) {
+        playerState   = p_READY;
+        playerReadyMs = now;
+        Serial.print("[MP3] DFPlayer ready after ");
+        Serial.print(now - playerStartMs);
+        Serial.println(" ms");
+
+        // Queued, not sent: df_poll() paces these out.
+        df_send(DF_CMD_VOLUME, currentVolume);
+        df_send(DF_CMD_PLAY_TRACK, currentTrack);
+        df_send(DF_CMD_PAUSE, 0);
+        df_send(DF_CMD_QUERY_STATUS, 0);
+        // A single reply, so cheap enough to re-check every boot in case
+        // the SD card was swapped; the flash copy is only rewritten on change.
+        df_send(DF_CMD_QUERY_FILES, 0);
         isPaused = true;
-    } else {
-        Serial.println("DFPlayer FAILED to init.");
+        return;
+    }
+
+    if (playerState == p_STARTING && now - playerStartMs >= PLAYER_BOOT_TIMEOUT_MS) {
+        playerState = p_ABSENT;
+        Serial.println("[MP3] No DFPlayer found, continuing without audio");
+    }
+
+    unsigned long interval = (playerState == p_STARTING) ? PLAYER_PROBE_MS : PLAYER_RETRY_MS;
+    if (df_idle() && (playerProbeMs == 0 || now - playerProbeMs >= interval)) {
+        df_send(DF_CMD_QUERY_STATUS, 0);
+        playerProbeMs = now;
     }
 }
 
@@ -86,44 +210,89 @@ String getParamValue(const String &query, const String &name) {
 // ---------------------------------------------------------------------------------------------
 // AUDIO CONTROL
 // ---------------------------------------------------------------------------------------------
-void syncTrackWithDFPlayer() {
-  int actual = player.readCurrentFileNumber();
-  if (actual > 0 && actual <= MAX_TRACKS) {
-    currentTrack = actual;
+// Ask the player which track it's on, once the last command has settled.
+void requestTrackSync(unsigned long settleMs) {
+  df_send(DF_CMD_QUERY_TRACK, 0, settleMs);
+}
+
+// Replies and events from the DFPlayer keep the cached state current.
+void mp3_onPlayerMessage(uint8_t cmd, uint16_t param) {
+  switch (cmd) {
+    case DF_MSG_ACK:
+      if (cueAwaitingAck && param == DF_CMD_ADVERT) {
+        latRecord(cueAckLatency, millis() - cues.playingTriggerMs);
+        cueAwaitingAck = false;
+      }
+      break;
+    case DF_CMD_QUERY_TRACK:
+      if (param > 0 && param <= trackCount) {
+        currentTrack = param;
+      }
+      break;
+    case DF_CMD_QUERY_FILES:
+      updateCatalog(param);
+      break;
+    case DF_CMD_QUERY_VOLUME:
+      currentVolume = param;
+      break;
+    case DF_CMD_QUERY_STATUS:
+      isPaused = ((param & 0xFF) != 1); // 0 stopped, 1 playing, 2 paused
+      break;
+    case DF_MSG_TRACK_FINISHED:
+      if (cues.playing != CUE_NONE) {
+        cueFinished(cues);
+        break;
+      }
+      isPaused = true;
+      requestTrackSync(0);
+      break;
+    case DF_MSG_ERROR:
+      Serial.print("[MP3] DFPlayer error ");
+      Serial.println(param);
+      break;
   }
 }
 
 void handlePlayPause() {
   if (isPaused) {
     Serial.println("[MP3] RESUME");
-    player.start();
+    df_send(DF_CMD_START, 0);
     isPaused = false;
   } else {
     Serial.println("[MP3] PAUSE");
-    player.pause();
+    df_send(DF_CMD_PAUSE, 0);
     isPaused = true;
   }
 
-  delay(120);
-  syncTrackWithDFPlayer();
+  requestTrackSync(120);
 }
 
 void handleNext() {
   Serial.println("[MP3] NEXT");
-  player.next();
   isPaused = false;
-  delay(150);
-  syncTrackWithDFPlayer();
+  // With a known count, ask for the track by number so a resend can't
+  // skip two; NEXT is only sent once.
+  if (trackCount > 0) {
+    currentTrack = currentTrack % trackCount + 1;
+    df_send(DF_CMD_PLAY_TRACK, currentTrack);
+  } else {
+    df_send(DF_CMD_NEXT, 0);
+  }
+  requestTrackSync(150);
   Serial.print("→ Now track ");
   Serial.println(currentTrack);
 }
 
 void handlePrevious() {
   Serial.println("[MP3] PREV");
-  player.previous();
   isPaused = false;
-  delay(150);
-  syncTrackWithDFPlayer();
+  if (trackCount > 0) {
+    currentTrack = currentTrack > 1 ? currentTrack - 1 : trackCount;
+    df_send(DF_CMD_PLAY_TRACK, currentTrack);
+  } else {
+    df_send(DF_CMD_PREVIOUS, 0);
+  }
+  requestTrackSync(150);
   Serial.print("→ Now track ");
   Serial.println(currentTrack);
 }
@@ -131,36 +300,213 @@ void handlePrevious() {
 void handleVolume(int v) {
   v = constrain(v, 0, 30);
   currentVolume = v;
-  player.volume(v);
+  df_send(DF_CMD_VOLUME, v);
+}
+
+// Tap: play/pause, next, previous. Holding NEXT/PREV steps the volume
+// up/down and keeps repeating; holding PLAY restarts the current track.
+void handleButton(const button_event &ev) {
+  bool hold = (ev.type == BTN_LONG || ev.type == BTN_REPEAT);
+
+  switch (ev.button) {
+    case BUTTON_PLAY:
+      if (ev.type == BTN_TAP) {
+        handlePlayPause();
+      } else if (ev.type == BTN_LONG) {
+        Serial.println("[MP3] RESTART");
+        df_send(DF_CMD_PLAY_TRACK, currentTrack);
+        isPaused = false;
+      }
+      break;
+    case BUTTON_NEXT:
+      if (ev.type == BTN_TAP) handleNext();
+      else if (hold) handleVolume(currentVolume + 1);
+      break;
+    case BUTTON_PREV:
+      if (ev.type == BTN_TAP) handlePrevious();
+      else if (hold) handleVolume(currentVolume - 1);
+      break;
+  }
 }
 
 
 // ---------------------------------------------------------------------------------------------
-// HANDLE /mp3/status (THIS FIXES YOUR MOBILE APP)
+// HANDLE /mp3/status
+// Served from a cached JSON body that's rebuilt only when the player state
+// changes. ?since=<version>&wait=<ms> long-polls until the version moves.
 // ---------------------------------------------------------------------------------------------
+const int MAX_STATUS_WAITERS = 2;
+const unsigned long MAX_STATUS_WAIT_MS = 25000;
+const unsigned long STATUS_WAITER_POLL_MS = 500;  // connected() is a bridge round trip
+
+typedef struct {
+  WiFiClient client;
+  unsigned long sinceVersion;
+  unsigned long deadline;
+  bool active;
+} status_waiter;
+
+status_waiter statusWaiters[MAX_STATUS_WAITERS];
+unsigned long lastWaiterPollMs = 0;
+
+unsigned long statusVersion = 1;
+bool lastPaused = true;
+int  lastTrack  = 1;
+int  lastVolume = 15;
+player_state lastPlayerState = p_STARTING;
+int  lastTrackCount = 0;
+
+char statusJson[192];
+unsigned long statusJsonVersion = 0;
+
+// Bump the version whenever anything the app shows has changed.
+void updateStatusVersion() {
+  if (isPaused != lastPaused || currentTrack != lastTrack || currentVolume != lastVolume ||
+      playerState != lastPlayerState || trackCount != lastTrackCount) {
+    lastPaused = isPaused;
+    lastTrack  = currentTrack;
+    lastVolume = currentVolume;
+    lastPlayerState = playerState;
+    lastTrackCount  = trackCount;
+    statusVersion++;
+  }
+}
+
+const char* cachedStatusJson() {
+  if (statusJsonVersion != statusVersion) {
+    snprintf(statusJson, sizeof(statusJson),
+             "{\"isPlaying\":%s,\"volume\":%d,\"currentTrack\":%d,"
+             "\"trackName\":\"%s\",\"maxTracks\":%d,\"player\":\"%s\","
+             "\"version\":%lu}",
+             isPaused ? "false" : "true", currentVolume, currentTrack,
+             trackName(currentTrack), trackCount, mp3_playerStateStr(), statusVersion);
+    statusJsonVersion = statusVersion;
+  }
+  return statusJson;
+}
+
 void sendStatus(WiFiClient &client) {
-  syncTrackWithDFPlayer();   // ← ALWAYS SYNC. This was your missing fix.
+  updateStatusVersion();
+
+  http_response &r = respBegin();
+  respStr(r, cachedStatusJson());
+  respSend(client, r, 200, "application/json");
+}
+
+// Returns true if the client was parked to wait for a change.
+bool handleStatusRequest(const String &path, WiFiClient &client) {
+  updateStatusVersion();
+
+  int q = path.indexOf('?');
+  String query = (q != -1 ? path.substring(q + 1) : "");
+  String since = getParamValue(query, "since");
+  String wait  = getParamValue(query, "wait");
+
+  if (since == "" || (unsigned long)since.toInt() != statusVersion) {
+    sendStatus(client);
+    return false;
+  }
+
+  unsigned long waitMs = wait != "" ? (unsigned long)wait.toInt() : MAX_STATUS_WAIT_MS;
+  if (waitMs > MAX_STATUS_WAIT_MS) waitMs = MAX_STATUS_WAIT_MS;
+
+  for (int i = 0; i < MAX_STATUS_WAITERS; i++) {
+    if (!statusWaiters[i].active) {
+      statusWaiters[i].client       = client;
+      statusWaiters[i].sinceVersion = statusVersion;
+      statusWaiters[i].deadline     = millis() + waitMs;
+      statusWaiters[i].active       = true;
+      return true;
+    }
+  }
+
+  // No free slot: answer now rather than hold up the loop.
+  sendStatus(client);
+  return false;
+}
+
+// Answer parked long-polls once the state changes or they time out. A
+// client that went away is only looked for every STATUS_WAITER_POLL_MS,
+// so an idle wait doesn't cost the control loop a round trip per pass.
+void serviceStatusWaiters(unsigned long now) {
+  bool pollLiveness = now - lastWaiterPollMs >= STATUS_WAITER_POLL_MS;
+  if (pollLiveness) lastWaiterPollMs = now;
+
+  for (int i = 0; i < MAX_STATUS_WAITERS; i++) {
+    status_waiter &w = statusWaiters[i];
+    if (!w.active) continue;
+
+    if (w.sinceVersion != statusVersion || (long)(now - w.deadline) >= 0) {
+      sendStatus(w.client);
+      w.client.stop();
+      w.active = false;
+    } else if (pollLiveness && !w.client.connected()) {
+      w.client.stop();
+      w.active = false;
+    }
+  }
+}
+
+
+// ---------------------------------------------------------------------------------------------
+// HANDLE /mp3/tracks?offset=<n>&limit=<n>
+// Built in the shared response buffer, so no String is ever built; the
+// page size keeps a full page well inside it.
+// ---------------------------------------------------------------------------------------------
+const int TRACKS_PAGE_DEFAULT = 20;
+const int TRACKS_PAGE_MAX     = 20;
+
+void handleTracksRequest(const String &path, WiFiClient &client) {
+  int q = path.indexOf('?');
+  String query  = (q != -1 ? path.substring(q + 1) : "");
+  String offArg = getParamValue(query, "offset");
+  String limArg = getParamValue(query, "limit");
+
+  int offset = offArg != "" ? constrain(offArg.toInt(), 0, trackCount) : 0;
+  int limit  = limArg != "" ? constrain(limArg.toInt(), 1, TRACKS_PAGE_MAX) : TRACKS_PAGE_DEFAULT;
+  int end    = constrain(offset + limit, 0, trackCount);
+
+  http_response &r = respBegin();
+  jsonOpen(r, '{');
+  jsonKey(r, "total");  jsonInt(r, trackCount);
+  jsonKey(r, "offset"); jsonInt(r, offset);
+  jsonKey(r, "tracks");
+  jsonOpen(r, '[');
+  for (int n = offset + 1; n <= end; n++) {
+    jsonOpen(r, '{');
+    jsonKey(r, "track"); jsonInt(r, n);
+    jsonKey(r, "name");  jsonString(r, trackName(n));
+    jsonClose(r, '}');
+  }
+  jsonClose(r, ']');
+  jsonClose(r, '}');
+  respSend(client, r, 200, "application/json");
+}
+
+
+// ---------------------------------------------------------------------------------------------
+// SOUND CUES
+// ---------------------------------------------------------------------------------------------
+void mp3_cue(sound_cue cue) {
+  cueTrigger(cues, cue, millis());
+}
 
-  const char* name = "Unknown";
-  if (currentTrack >= 1 && currentTrack <= MAX_TRACKS) {
-    name = TRACK_NAMES[currentTrack - 1];
+const latency_stats& mp3_cueAckLatency() {
+  return cueAckLatency;
+}
+
+void serviceCues(unsigned long now) {
+  if (playerState != p_READY || isPaused) {
+    cueClear(cues);
+    return;
   }
 
-  client.println("HTTP/1.1 200 OK");
-  client.println("Content-Type: application/json");
-  client.println("Connection: close");
-  client.println();
-  client.print("{\"isPlaying\":");
-  client.print(isPaused ? "false" : "true");
-  client.print(",\"volume\":");
-  client.print(currentVolume);
-  client.print(",\"currentTrack\":");
-  client.print(currentTrack);
-  client.print(",\"trackName\":\"");
-  client.print(name);
-  client.print("\",\"maxTracks\":");
-  client.print(MAX_TRACKS);
-  client.println("}");
+  sound_cue c = cueNext(cues, now);
+  if (c == CUE_NONE) return;
+
+  bool sent = df_sendUrgent(DF_CMD_ADVERT, c);
+  cueAwaitingAck = sent;
+  if (!sent) cueFinished(cues);
 }
 
 
@@ -171,29 +517,32 @@ void sendStatus(WiFiClient &client) {
 void mp3_loop() {
     unsigned long now = millis();
 
-    if (now - lastPress > debounceDelay) {
-        if (digitalRead(BTN_PLAY) == LOW) { lastPress = now; handlePlayPause(); }
-        if (digitalRead(BTN_NEXT) == LOW) { lastPress = now; handleNext(); }
-        if (digitalRead(BTN_PREV) == LOW) { lastPress = now; handlePrevious(); }
-    }
-}
-
+    df_poll(now);
+    servicePlayerBringUp(now);
+    serviceCues(now);
 
-void mp3_handleRequest(const String &path, WiFiClient &client) {
-    if (path.startsWith("/mp3/status")) {
-        sendStatus(client);
-        return;
+    button_event ev;
+    while (buttons_poll(now, ev)) {
+        if (playerState == p_READY) handleButton(ev);
     }
 
-    int q = path.indexOf('?');
-    String query = (q != -1 ? path.substring(q + 1) : "");
+    updateStatusVersion();
+    serviceStatusWaiters(now);
+}
+
 
+mp3_cmd_result mp3_applyCommand(const String &query) {
     String cmd   = getParamValue(query, "cmd");
     String vol   = getParamValue(query, "volume");
     String track = getParamValue(query, "track");
 
+    if (cmd == "" && vol == "" && track == "") return MP3_CMD_NONE;
+    if (playerState != p_READY) return MP3_CMD_NOT_READY;
+
     if (track != "") {
-        player.play(track.toInt());
+        int t = track.toInt();
+        df_send(DF_CMD_PLAY_TRACK, t);
+        if (t >= 1 && t <= trackCount) currentTrack = t;
         isPaused = false;
     } else if (vol != "") {
         handleVolume(vol.toInt());
@@ -204,9 +553,36 @@ void mp3_handleRequest(const String &path, WiFiClient &client) {
     } else if (cmd == "play" || cmd == "pause") {
         handlePlayPause();
     }
+    return MP3_CMD_APPLIED;
+}
+
+void mp3_writeStatus(http_response &r) {
+    updateStatusVersion();
+    jsonRaw(r, cachedStatusJson());
+}
+
+
+bool mp3_handleRequest(const String &path, WiFiClient &client) {
+    if (path.startsWith("/mp3/status")) {
+        return handleStatusRequest(path, client);
+    }
+    if (path.startsWith("/mp3/tracks")) {
+        handleTracksRequest(path, client);
+        return false;
+    }
+
+    int q = path.indexOf('?');
+    String query = (q != -1 ? path.substring(q + 1) : "");
+
+    if (mp3_applyCommand(query) == MP3_CMD_NOT_READY) {
+        http_response &r = respBegin();
+        respStr(r, "MP3 player not ready");
+        respSend(client, r, 503, "text/plain");
+        return false;
+    }
 
-    client.println("HTTP/1.1 200 OK");
-    client.println("Connection: close");
-    client.println();
-    client.println("OK");
+    http_response &r = respBegin();
+    respStr(r, "OK");
+    respSend(client, r, 200, "text/plain");
+    return false;
 }
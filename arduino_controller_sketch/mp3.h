@@ -1,6 +1,31 @@
 #pragma once
 #include <WiFiS3.h>
+#include "http_response.h"
+#include "sound_cues.h"
+#include "latency_stats.h"
+
+typedef enum {
+  MP3_CMD_NONE      = 0, // no cmd/volume/track in the query
+  MP3_CMD_APPLIED   = 1,
+  MP3_CMD_NOT_READY = 2,
+} mp3_cmd_result;
 
 void mp3_init();                        
 void mp3_loop();                        
-void mp3_handleRequest(const String &path, WiFiClient &client);
\ No newline at end of file
+// millis() at which the DFPlayer answered, 0 while starting or absent.
+unsigned long mp3_playerReadyMs();
+const char* mp3_playerStateStr();
+// Returns true if the request was parked (long-poll) and the caller must
+// not close the client.
+bool mp3_handleRequest(const String &path, WiFiClient &client);
+// Shared with /state: apply cmd/volume/track from a query, and write the
+// player status object.
+mp3_cmd_result mp3_applyCommand(const String &query);
+void mp3_writeStatus(http_response &r);
+
+// Raise a sound cue. Only sets a flag; safe to call from the control loop.
+void mp3_cue(sound_cue cue);
+// Cue trigger -> DFPlayer acknowledged the advert command, in ms. The
+// player gives no signal when the clip is audible, so this is a lower
+// bound on trigger-to-sound latency.
+const latency_stats& mp3_cueAckLatency();
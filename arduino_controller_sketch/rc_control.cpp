@@ -1,6 +1,13 @@
 #include "rc_car.h"
 #include "rc_control.h"
+#include "clamp.h"
 #include "fsm.h"
+#include "link_governor.h"
+#include "jitter_buffer.h"
+#include "latency_stats.h"
+#include "http_send.h"
+#include "clock_sync.h"
+#include "mp3.h"
 // #include <WiFiS3.h>
 #include <Servo.h>
 #include <WDT.h>
@@ -32,6 +39,7 @@ float curDistanceCm = 1000.0f; // The current distance calculated by the ultrase
 
 //WDT
 const int wdtInterval = 5000;
+bool wdtArmed = false;  // WDT.refresh() before WDT.begin() isn't defined
 
 // Command inputs from app (latest requested values)
 int latestThrottleCmd = 0;  // -255..255
@@ -40,6 +48,31 @@ int latestTurnCmd     = 0;  // -255..255
 // FSM state
 full_state carState;
 
+// Link quality governor (caps throttle on a bad link, stops on a dead one)
+link_state linkState;
+link_mode  lastLinkMode = l_NO_LINK; // for sound cues on mode changes
+
+// Timestamped commands from the app, replayed at a steady rate
+jitter_buffer cmdBuffer;
+
+// Latency echo: app's seq/t plus our receive and apply times
+typedef struct {
+  unsigned long seq;
+  unsigned long clientMs;
+  unsigned long rxMs;
+  unsigned long appliedMs;
+  unsigned long appliedTick;
+  bool buffered;          // went through cmdBuffer rather than direct
+  uint64_t rxUs;          // clock_nowUs() twins of rxMs/appliedMs
+  uint64_t appliedUs;
+} cmd_echo;
+
+cmd_echo pendingCmd;      // newest command, not yet acted on by the FSM
+cmd_echo appliedCmd;      // last command the FSM acted on
+bool cmdPending = false;
+unsigned long loopTick = 0;
+latency_stats applyLatency; // receive -> FSM apply, ms
+
 // --- Helpers to parse query params from "GET /drive?ud=...&lr=... HTTP/1.1" ---
 
 int getParamValue(const String &query, const String &name, bool &found) {
@@ -61,6 +94,18 @@ int getParamValue(const String &query, const String &name, bool &found) {
   return valueStr.toInt();
 }
 
+// Same as getParamValue, for full-range unsigned 32-bit values (timestamps).
+unsigned long getParamULong(const String &query, const String &name, bool &found) {
+  int idx = query.indexOf(name + "=");
+  if (idx == -1) {
+    found = false;
+    return 0;
+  }
+  int start = idx + name.length() + 1;
+  found = true;
+  return strtoul(query.c_str() + start, NULL, 10);
+}
+
 // Clamp helper
 int clampInt(int val, int minVal, int maxVal) {
   if (val < minVal) return minVal;
@@ -188,6 +233,11 @@ void car_init() {
   carState.turn                   = 0;
   carState.state                  = s_IDLE;
 
+  linkState = initLinkGovernor(millis());
+  jbReset(cmdBuffer);
+  latInit(applyLatency, 4);
+  appliedCmd = {0, 0, 0, 0, 0, false, 0, 0};
+
   // Ensure drive motors are off at start
   setThrottleOutput(0);
 
@@ -211,8 +261,20 @@ void car_init() {
   //   // do nothing
   // }
   // ---------- Testing code end ----------
+}
 
+// Armed separately so setup() can bring the car to a safe state first and
+// only start the watchdog once nothing left in setup() blocks for seconds.
+void car_startWatchdog() {
   WDT.begin(wdtInterval);
+  wdtArmed = true;
+}
+
+// Drop the last command (and anything buffered) so the FSM settles to IDLE.
+void car_holdStopped() {
+  latestThrottleCmd = 0;
+  latestTurnCmd     = 0;
+  jbFlush(cmdBuffer);
 }
 
 void car_loop() {
@@ -230,38 +292,194 @@ void car_loop() {
 
   calculateDistance();
 
-  // 3. FSM update: compute next state from current + inputs
+  // 3. Commands: replay timestamped ones through the jitter buffer,
+  //    otherwise use whatever arrived last
+  int throttleCmd = latestThrottleCmd;
+  int turnCmd     = latestTurnCmd;
+  jbPlayout(cmdBuffer, curTime, throttleCmd, turnCmd);
+
+  // 4. Link governor: cap throttle by link quality, ramp down if silent
+  linkState = updateLinkGovernor(linkState, throttleCmd, curTime);
+
+  // Once a lost link has ramped to a stop, drop steering too so we go IDLE
+  if (linkState.mode == l_LOST && linkState.outThrottle == 0) {
+    turnCmd = 0;
+  }
+
+  // 5. FSM update: compute next state from current + inputs
+  full_state prevState = carState;
   carState = updateFSM(carState,
-                       latestThrottleCmd,
-                       latestTurnCmd,
+                       linkState.outThrottle,
+                       turnCmd,
                        curDistanceCm);
 
-  // 4. Apply outputs to hardware
+  // Sound cues for events the driver can't see from the camera
+  if (fsmEvent(prevState, carState, linkState.outThrottle) == e_OBSTACLE_STOP) {
+    mp3_cue(CUE_OBSTACLE);
+  }
+  if (linkState.mode != lastLinkMode) {
+    if (linkState.mode == l_LOST)     mp3_cue(CUE_LINK_LOST);
+    if (linkState.mode == l_DEGRADED) mp3_cue(CUE_LINK_DEGRADED);
+    if (linkState.mode == l_OK &&
+        (lastLinkMode == l_LOST || lastLinkMode == l_DEGRADED)) {
+      mp3_cue(CUE_LINK_RESTORED);
+    }
+    lastLinkMode = linkState.mode;
+  }
+
+  // 6. Apply outputs to hardware
   setThrottleOutput(carState.throttle);
   setSteeringOutput(carState.turn);
 
+  // Record receive -> apply latency once playout has reached the command
+  loopTick++;
+  if (cmdPending &&
+      (!pendingCmd.buffered ||
+       jbPlayedThrough(cmdBuffer, curTime, pendingCmd.clientMs))) {
+    unsigned long appliedAt = millis();
+    pendingCmd.appliedMs   = appliedAt;
+    pendingCmd.appliedUs   = clock_nowUs();
+    pendingCmd.appliedTick = loopTick;
+    latRecord(applyLatency, appliedAt - pendingCmd.rxMs);
+    appliedCmd = pendingCmd;
+    cmdPending = false;
+  }
+
   // wdt_reset();
-  WDT.refresh();
+  if (wdtArmed) WDT.refresh();
 
-  // 5. Small delay to keep loop from spinning too hard
+  // 7. Small delay to keep loop from spinning too hard
   delay(10);
 }
 
-void car_handleRequest(const String &path, WiFiClient &client) {
-    if (!path.startsWith("/drive")) return;
+// --- /telemetry: FSM + link governor state as JSON ---
 
-    int qIndex = path.indexOf('?');
-    String query = qIndex != -1 ? path.substring(qIndex + 1) : "";
+void sendTelemetry(WiFiClient &client) {
+  unsigned long now = millis();
+  int64_t phoneUs;
+  bool synced = clock_toPhoneUs(clock_nowUs(), phoneUs);
+  http_response &r = respBegin();
 
-    bool hasUD = false, hasLR = false;
+  jsonOpen(r, '{');
+  // When this snapshot was taken, on the phone's clock (once synced).
+  if (synced) {
+    jsonKey(r, "phoneUs");  jsonInt(r, phoneUs);
+  }
+  jsonKey(r, "state");      jsonString(r, carState.state == s_MOVE ? "MOVE" : "IDLE");
+  jsonKey(r, "throttle");   jsonInt(r, carState.throttle);
+  jsonKey(r, "turn");       jsonInt(r, carState.turn);
+  jsonKey(r, "distanceCm"); jsonInt(r, (int)carState.distance_from_obstacle);
+
+  jsonKey(r, "link");
+  jsonOpen(r, '{');
+  jsonKey(r, "mode");        jsonString(r, linkModeToStr(linkState.mode));
+  jsonKey(r, "intervalMs");  jsonInt(r, (int)linkState.intervalMs);
+  jsonKey(r, "jitterMs");    jsonInt(r, (int)linkState.jitterMs);
+  jsonKey(r, "silentMs");    jsonUInt(r, linkState.cmdCount ? now - linkState.lastCmdMs : 0);
+  jsonKey(r, "throttleCap"); jsonInt(r, linkState.throttleCap);
+  jsonKey(r, "cmdCount");    jsonUInt(r, linkState.cmdCount);
+  jsonClose(r, '}');
+
+  jsonKey(r, "jitterBuffer");
+  jsonOpen(r, '{');
+  jsonKey(r, "depth");         jsonInt(r, cmdBuffer.count);
+  jsonKey(r, "delayMs");       jsonUInt(r, cmdBuffer.delayMs);
+  jsonKey(r, "jitterMs");      jsonInt(r, (int)cmdBuffer.jitterMs);
+  jsonKey(r, "extrapolating"); jsonBool(r, cmdBuffer.extrapolating);
+  jsonClose(r, '}');
+
+  jsonKey(r, "applyLatencyMs"); jsonLatency(r, applyLatency);
+  jsonKey(r, "httpUs");         jsonLatency(r, httpLatency);
+  jsonKey(r, "cueAckLatencyMs"); jsonLatency(r, mp3_cueAckLatency());
+  jsonClose(r, '}');
+
+  respSend(client, r, 200, "application/json");
+}
+
+void car_applyDrive(const String &query, drive_echo &echo) {
+    unsigned long rxMs = millis();
+    uint64_t rxUs = clock_nowUs();
+    linkState = linkOnCommand(linkState, rxMs);
+
+    bool hasUD = false, hasLR = false, hasT = false, hasSeq = false;
     int ud = getParamValue(query, "ud", hasUD);
     int lr = getParamValue(query, "lr", hasLR);
+    unsigned long t   = getParamULong(query, "t", hasT);
+    unsigned long seq = getParamULong(query, "seq", hasSeq);
 
     if (hasUD) latestThrottleCmd = clampInt(ud, -255, 255);
     if (hasLR) latestTurnCmd     = clampInt(lr, -255, 255);
 
-    client.println("HTTP/1.1 200 OK");
-    client.println("Connection: close");
-    client.println();
-    client.println("OK");
-}
\ No newline at end of file
+    bool buffered = false;
+    if (latestThrottleCmd == 0 && latestTurnCmd == 0) {
+      // Stops skip the buffer so they apply on the very next tick.
+      jbFlush(cmdBuffer);
+    } else if (hasT) {
+      jbPush(cmdBuffer, t, latestThrottleCmd, latestTurnCmd, rxMs);
+      buffered = true;
+    }
+
+    pendingCmd = {seq, t, rxMs, 0, 0, buffered, rxUs, 0};
+    cmdPending = true;
+
+    echo.seq  = seq;
+    echo.t    = t;
+    echo.rxMs = rxMs;
+    echo.rxUs = rxUs;
+}
+
+// This command's ids and receive time, plus the last command the FSM
+// actually applied (this one hasn't been yet). Once /time has synced, the
+// receive and apply times are also given on the phone's clock (rxPhone,
+// atPhone, in us) so the app can line them up with its own send times.
+void car_writeDriveEcho(http_response &r, const drive_echo &echo) {
+    int64_t phoneUs;
+    jsonOpen(r, '{');
+    jsonKey(r, "seq");  jsonUInt(r, echo.seq);
+    jsonKey(r, "t");    jsonUInt(r, echo.t);
+    jsonKey(r, "rx");   jsonUInt(r, echo.rxMs);
+    if (clock_toPhoneUs(echo.rxUs, phoneUs)) {
+        jsonKey(r, "rxPhone"); jsonInt(r, phoneUs);
+    }
+    jsonKey(r, "tick"); jsonUInt(r, loopTick);
+    jsonKey(r, "applied");
+    jsonOpen(r, '{');
+    jsonKey(r, "seq");  jsonUInt(r, appliedCmd.seq);
+    jsonKey(r, "t");    jsonUInt(r, appliedCmd.clientMs);
+    jsonKey(r, "rx");   jsonUInt(r, appliedCmd.rxMs);
+    jsonKey(r, "at");   jsonUInt(r, appliedCmd.appliedMs);
+    if (appliedCmd.appliedUs && clock_toPhoneUs(appliedCmd.appliedUs, phoneUs)) {
+        jsonKey(r, "atPhone"); jsonInt(r, phoneUs);
+    }
+    jsonKey(r, "tick"); jsonUInt(r, appliedCmd.appliedTick);
+    jsonClose(r, '}');
+    jsonClose(r, '}');
+}
+
+void car_writeState(http_response &r) {
+    jsonOpen(r, '{');
+    jsonKey(r, "state");      jsonString(r, carState.state == s_MOVE ? "MOVE" : "IDLE");
+    jsonKey(r, "throttle");   jsonInt(r, carState.throttle);
+    jsonKey(r, "turn");       jsonInt(r, carState.turn);
+    jsonKey(r, "distanceCm"); jsonInt(r, (int)carState.distance_from_obstacle);
+    jsonKey(r, "link");       jsonString(r, linkModeToStr(linkState.mode));
+    jsonClose(r, '}');
+}
+
+void car_handleRequest(const String &path, WiFiClient &client) {
+    if (path.startsWith("/telemetry")) {
+        sendTelemetry(client);
+        return;
+    }
+    if (!path.startsWith("/drive")) return;
+
+    int qIndex = path.indexOf('?');
+    String query = qIndex != -1 ? path.substring(qIndex + 1) : "";
+
+    drive_echo echo;
+    car_applyDrive(query, echo);
+
+    http_response &r = respBegin();
+    car_writeDriveEcho(r, echo);
+    respSend(client, r, 200, "application/json");
+}
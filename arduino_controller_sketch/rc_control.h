@@ -1,6 +1,22 @@
 #pragma once
 #include <WiFiS3.h>
+#include "http_response.h"
+
+typedef struct {
+  unsigned long seq;
+  unsigned long t;
+  unsigned long rxMs;
+  uint64_t rxUs;  // clock_nowUs() at receive, for the phone-time echo
+} drive_echo;
 
 void car_init();
+void car_startWatchdog();
 void car_loop();
-void car_handleRequest(const String &path, WiFiClient &client);
\ No newline at end of file
+void car_holdStopped();
+void car_handleRequest(const String &path, WiFiClient &client);
+
+// Shared with /state: apply ud/lr/t/seq from a query and write the pieces
+// of the reply.
+void car_applyDrive(const String &query, drive_echo &echo);
+void car_writeDriveEcho(http_response &r, const drive_echo &echo);
+void car_writeState(http_response &r);
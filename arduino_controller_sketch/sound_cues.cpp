@@ -0,0 +1,63 @@
+// sound_cues.cpp
+#include "sound_cues.h"
+
+const unsigned long CUE_REPEAT_HOLDOFF_MS = 2000; // stop a flapping sensor nagging
+const unsigned long CUE_MAX_PLAY_MS       = 3000; // treat as finished after this
+const unsigned long CUE_MAX_WAIT_MS       = 4000; // drop a cue this late; outlasts MAX_PLAY
+
+void cueInit(cue_queue &q) {
+  for (int i = 0; i < CUE_COUNT; i++) {
+    q.triggerMs[i]  = 0;
+    q.lastPlayMs[i] = 0;
+  }
+  q.pending          = 0;
+  q.playing          = CUE_NONE;
+  q.playingSinceMs   = 0;
+  q.playingTriggerMs = 0;
+}
+
+void cueTrigger(cue_queue &q, sound_cue cue, unsigned long nowMs) {
+  if (cue <= CUE_NONE || cue >= CUE_COUNT) return;
+  uint8_t bit = (uint8_t)(1 << cue);
+  if (q.pending & bit) return;
+  if (q.lastPlayMs[cue] != 0 && nowMs - q.lastPlayMs[cue] < CUE_REPEAT_HOLDOFF_MS) return;
+  q.pending |= bit;
+  q.triggerMs[cue] = nowMs;
+}
+
+sound_cue cueNext(cue_queue &q, unsigned long nowMs) {
+  // Some players never report the end of an inserted clip.
+  if (q.playing != CUE_NONE && nowMs - q.playingSinceMs >= CUE_MAX_PLAY_MS) {
+    q.playing = CUE_NONE;
+  }
+
+  for (int c = CUE_NONE + 1; c < CUE_COUNT; c++) {
+    if ((q.pending & (1 << c)) && nowMs - q.triggerMs[c] >= CUE_MAX_WAIT_MS) {
+      q.pending &= (uint8_t)~(1 << c);
+    }
+  }
+
+  for (int c = CUE_COUNT - 1; c > CUE_NONE; c--) {
+    if (!(q.pending & (1 << c))) continue;
+    if (c <= q.playing) return CUE_NONE;
+
+    // Takes this cue and drops the lower ones waiting behind it; they
+    // were raised before it and would only play late.
+    q.pending &= (uint8_t)~((1 << (c + 1)) - 1);
+    q.playing          = (sound_cue)c;
+    q.playingSinceMs   = nowMs;
+    q.playingTriggerMs = q.triggerMs[c];
+    q.lastPlayMs[c]    = nowMs;
+    return (sound_cue)c;
+  }
+  return CUE_NONE;
+}
+
+void cueFinished(cue_queue &q) {
+  q.playing = CUE_NONE;
+}
+
+void cueClear(cue_queue &q) {
+  q.pending = 0;
+  q.playing = CUE_NONE;
+}
@@ -0,0 +1,48 @@
+// sound_cues.h
+#ifndef SOUND_CUES_H
+#define SOUND_CUES_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Short audio cues for control events. Triggering only sets a flag, so it's
+// safe to call from the control loop; the MP3 loop picks the highest
+// priority pending cue and plays it, preempting a lower one already playing.
+// Higher enum value = higher priority. The value is also the cue's file
+// number (/ADVERT/000N.mp3 on the SD card).
+typedef enum {
+  CUE_NONE          = 0,
+  CUE_LINK_RESTORED = 1,
+  CUE_LINK_DEGRADED = 2,
+  CUE_OBSTACLE      = 3,
+  CUE_LINK_LOST     = 4,
+  CUE_COUNT         = 5,
+} sound_cue;
+
+typedef struct {
+  unsigned long triggerMs[CUE_COUNT];  // when each pending cue was raised
+  unsigned long lastPlayMs[CUE_COUNT]; // for the repeat hold-off
+  uint8_t pending;                     // bit per cue
+  sound_cue playing;
+  unsigned long playingSinceMs;
+  unsigned long playingTriggerMs;      // trigger time of the playing cue
+} cue_queue;
+
+void cueInit(cue_queue &q);
+
+// Raise a cue. Ignored if the same cue played within the hold-off, and
+// coalesced with an earlier trigger that hasn't played yet.
+void cueTrigger(cue_queue &q, sound_cue cue, unsigned long nowMs);
+
+// Next cue to start now, or CUE_NONE. A cue is started if nothing is
+// playing or it outranks the one that is; it then becomes `playing`, and
+// lower cues still pending are dropped. A cue that has waited too long to
+// play is dropped too.
+sound_cue cueNext(cue_queue &q, unsigned long nowMs);
+
+void cueFinished(cue_queue &q);
+
+// Drop everything pending (e.g. no player fitted).
+void cueClear(cue_queue &q);
+
+#endif
@@ -0,0 +1,28 @@
+// track_catalog.cpp
+#include "track_catalog.h"
+#include "checksum.h"
+
+uint16_t catalogChecksum(const track_catalog &c) {
+  uint8_t bytes[6] = {
+    (uint8_t)(c.magic >> 8), (uint8_t)(c.magic & 0xFF),
+    c.version, c.reserved,
+    (uint8_t)(c.trackCount >> 8), (uint8_t)(c.trackCount & 0xFF),
+  };
+  return fletcher16(bytes, sizeof(bytes));
+}
+
+void catalogMake(track_catalog &c, uint16_t trackCount) {
+  if (trackCount > CATALOG_MAX_TRACKS) trackCount = CATALOG_MAX_TRACKS;
+  c.magic      = CATALOG_MAGIC;
+  c.version    = CATALOG_VERSION;
+  c.reserved   = 0;
+  c.trackCount = trackCount;
+  c.checksum   = catalogChecksum(c);
+}
+
+bool catalogValid(const track_catalog &c) {
+  return c.magic == CATALOG_MAGIC &&
+         c.version == CATALOG_VERSION &&
+         c.trackCount > 0 && c.trackCount <= CATALOG_MAX_TRACKS &&
+         c.checksum == catalogChecksum(c);
+}
@@ -0,0 +1,31 @@
+// track_catalog.h
+#ifndef TRACK_CATALOG_H
+#define TRACK_CATALOG_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Compact record of what's on the DFPlayer's SD card, persisted in EEPROM
+// so a reboot knows the track count before the player has answered. The
+// player can't report file names, so names come from a built-in table
+// (see mp3.cpp) with "Track N" for anything past it.
+
+#define CATALOG_MAGIC      0x5443 // "TC"
+#define CATALOG_VERSION    1
+#define CATALOG_MAX_TRACKS 255
+#define CATALOG_EEPROM_ADDR 0
+
+typedef struct {
+  uint16_t magic;
+  uint8_t  version;
+  uint8_t  reserved;
+  uint16_t trackCount;
+  uint16_t checksum; // Fletcher-16 over the bytes above
+} track_catalog;
+
+uint16_t catalogChecksum(const track_catalog &c);
+void catalogMake(track_catalog &c, uint16_t trackCount);
+// False for a zero count too: that's a card the player couldn't read.
+bool catalogValid(const track_catalog &c);
+
+#endif
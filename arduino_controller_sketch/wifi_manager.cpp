@@ -0,0 +1,232 @@
+// wifi_manager.cpp
+#include "wifi_manager.h"
+#include "checksum.h"
+#include <EEPROM.h>
+#include <stddef.h>
+#include <string.h>
+
+// WiFi.begin() waits on the bridge for up to this long; kept well under
+// the watchdog interval. Association carries on after it returns.
+const unsigned long WIFI_BEGIN_BLOCK_MS   = 1000;
+const unsigned long WIFI_CONNECT_TIMEOUT_MS = 15000;
+const unsigned long WIFI_POLL_CONNECTING_MS = 100;
+const unsigned long WIFI_POLL_CONNECTED_MS  = 500;  // status() is a bridge round trip
+const unsigned long WIFI_BACKOFF_MIN_MS = 500;
+const unsigned long WIFI_BACKOFF_MAX_MS = 8000;
+
+static const char *wifiSsid = NULL;
+static const char *wifiPassword = NULL;
+
+static wifi_stats stats;
+static wifi_cache cache;
+static bool cacheValid = false;
+static bool staticApplied = false;  // WiFi.config() has set a static address
+static bool checkFallback = false;  // next DHCP lease must differ from rejectedIp
+static uint8_t rejectedIp[4];
+static bool justConnected = false;
+
+static unsigned long attemptStartMs = 0;
+static unsigned long lastPollMs = 0;
+static unsigned long backoffUntilMs = 0;
+static unsigned long failuresInARow = 0;
+
+// --- Cache record ---
+
+void wifiCacheMake(wifi_cache &c, const uint8_t ip[4], const uint8_t gateway[4],
+                   const uint8_t subnet[4], const uint8_t dns[4]) {
+  c.magic    = WIFI_CACHE_MAGIC;
+  c.version  = WIFI_CACHE_VERSION;
+  c.reserved = 0;
+  memcpy(c.ip, ip, 4);
+  memcpy(c.gateway, gateway, 4);
+  memcpy(c.subnet, subnet, 4);
+  memcpy(c.dns, dns, 4);
+  c.checksum = fletcher16((const uint8_t*)&c, offsetof(wifi_cache, checksum));
+}
+
+bool wifiCacheValid(const wifi_cache &c) {
+  return c.magic == WIFI_CACHE_MAGIC &&
+         c.version == WIFI_CACHE_VERSION &&
+         c.ip[0] != 0 &&
+         c.checksum == fletcher16((const uint8_t*)&c, offsetof(wifi_cache, checksum));
+}
+
+// --- Backoff ---
+
+unsigned long wifiBackoffMs(unsigned long failures) {
+  unsigned long ms = WIFI_BACKOFF_MIN_MS;
+  for (unsigned long i = 0; i < failures && ms < WIFI_BACKOFF_MAX_MS; i++) ms *= 2;
+  return ms > WIFI_BACKOFF_MAX_MS ? WIFI_BACKOFF_MAX_MS : ms;
+}
+
+static void toBytes(const IPAddress &a, uint8_t out[4]) {
+  for (int i = 0; i < 4; i++) out[i] = a[i];
+}
+
+static IPAddress fromBytes(const uint8_t b[4]) {
+  return IPAddress(b[0], b[1], b[2], b[3]);
+}
+
+// Only writes flash when the lease actually changed.
+static void saveCache() {
+  uint8_t ip[4], gw[4], mask[4], dns[4];
+  toBytes(WiFi.localIP(), ip);
+  toBytes(WiFi.gatewayIP(), gw);
+  toBytes(WiFi.subnetMask(), mask);
+  toBytes(WiFi.dnsIP(0), dns);
+
+  wifi_cache fresh;
+  wifiCacheMake(fresh, ip, gw, mask, dns);
+  if (cacheValid && memcmp(&fresh, &cache, sizeof(fresh)) == 0) return;
+  if (!wifiCacheValid(fresh)) return;
+
+  cache = fresh;
+  cacheValid = true;
+  EEPROM.put(WIFI_CACHE_EEPROM_ADDR, cache);
+}
+
+// The cached lease didn't work here; erase it so the next boot skips it too.
+static void rejectCache() {
+  stats.cacheRejects++;
+  memcpy(rejectedIp, cache.ip, 4);
+  checkFallback = true;
+  cacheValid = false;
+  memset(&cache, 0, sizeof(cache));
+  EEPROM.put(WIFI_CACHE_EEPROM_ADDR, cache);
+}
+
+// Called once associated. False if the address in use is no good and the
+// attempt should be dropped.
+static bool checkLease() {
+  if (stats.usedCache) {
+    // One ICMP round trip through the bridge; its own timeout is well
+    // under the watchdog interval.
+    if (WiFi.ping(fromBytes(cache.gateway)) >= 0) return true;
+    rejectCache();
+    return false;
+  }
+
+  if (checkFallback) {
+    uint8_t ip[4];
+    toBytes(WiFi.localIP(), ip);
+    stats.dhcpStuck = memcmp(ip, rejectedIp, 4) == 0;
+    checkFallback = false;
+    if (stats.dhcpStuck) {
+      Serial.println("[WIFI] DHCP fallback kept the cached address; power-cycle to recover");
+      return true;
+    }
+  }
+  saveCache();
+  return true;
+}
+
+// --- State machine ---
+
+static void startAttempt(unsigned long now) {
+  stats.usedCache = cacheValid;
+  if (cacheValid) {
+    WiFi.config(fromBytes(cache.ip), fromBytes(cache.dns),
+                fromBytes(cache.gateway), fromBytes(cache.subnet));
+    staticApplied = true;
+  } else if (staticApplied) {
+    // Back to DHCP; the bridge's ESP32 WiFi stack takes an all-zero
+    // address as "use DHCP". checkLease() confirms it did.
+    WiFi.config(IPAddress(0, 0, 0, 0));
+    staticApplied = false;
+  }
+  WiFi.begin(wifiSsid, wifiPassword);
+
+  stats.state    = w_CONNECTING;
+  attemptStartMs = now;
+  lastPollMs     = now;
+}
+
+static void failAttempt(unsigned long now) {
+  stats.failures++;
+  failuresInARow++;
+  WiFi.disconnect();
+  stats.state    = w_BACKOFF;
+  backoffUntilMs = now + wifiBackoffMs(failuresInARow - 1);
+}
+
+void wifi_begin(const char *ssid, const char *password) {
+  wifiSsid     = ssid;
+  wifiPassword = password;
+  stats = {w_IDLE, 0, 0, 0, 0, 0, false, 0, false};
+
+  EEPROM.get(WIFI_CACHE_EEPROM_ADDR, cache);
+  cacheValid = wifiCacheValid(cache);
+
+  WiFi.setTimeout(WIFI_BEGIN_BLOCK_MS);
+  startAttempt(millis());
+}
+
+void wifi_loop() {
+  unsigned long now = millis();
+
+  switch (stats.state) {
+    case w_IDLE:
+      break;
+
+    case w_CONNECTING:
+      if (now - lastPollMs < WIFI_POLL_CONNECTING_MS) break;
+      lastPollMs = now;
+
+      if (WiFi.status() == WL_CONNECTED) {
+        if (!checkLease()) {
+          // Straight on to a DHCP attempt; this isn't a link failure.
+          WiFi.disconnect();
+          startAttempt(now);
+          break;
+        }
+        stats.state = w_CONNECTED;
+        stats.connects++;
+        stats.lastConnectMs = now - attemptStartMs;
+        if (stats.firstConnectMs == 0) stats.firstConnectMs = now;
+        failuresInARow = 0;
+        justConnected  = true;
+      } else if (now - attemptStartMs >= WIFI_CONNECT_TIMEOUT_MS) {
+        failAttempt(now);
+      }
+      break;
+
+    case w_CONNECTED:
+      if (now - lastPollMs < WIFI_POLL_CONNECTED_MS) break;
+      lastPollMs = now;
+
+      if (WiFi.status() != WL_CONNECTED) {
+        stats.reconnects++;
+        stats.state    = w_BACKOFF;
+        backoffUntilMs = now; // first retry straight away
+      }
+      break;
+
+    case w_BACKOFF:
+      if ((long)(now - backoffUntilMs) >= 0) startAttempt(now);
+      break;
+  }
+}
+
+bool wifi_connected() {
+  return stats.state == w_CONNECTED;
+}
+
+bool wifi_justConnected() {
+  bool was = justConnected;
+  justConnected = false;
+  return was;
+}
+
+wifi_stats wifi_getStats() {
+  return stats;
+}
+
+const char* wifiStateToStr(wifi_state s) {
+  switch (s) {
+    case w_IDLE:       return "IDLE";
+    case w_CONNECTING: return "CONNECTING";
+    case w_CONNECTED:  return "CONNECTED";
+    case w_BACKOFF:    return "BACKOFF";
+  }
+  return "UNKNOWN";
+}
@@ -0,0 +1,64 @@
+// wifi_manager.h
+#pragma once
+#include <WiFiS3.h>
+
+// Non-blocking WiFi connection manager. wifi_loop() drives the connection
+// as a state machine: attempts reuse the IP configuration cached in EEPROM
+// (skipping DHCP), and reconnect with backoff whenever the link drops.
+//
+// A static address still associates on the wrong network, so a cached
+// lease is checked by pinging its gateway once associated. If that fails
+// the cache is erased and the next attempt asks for DHCP, and the address
+// that attempt ends up with is checked in turn: if it is still the
+// rejected one, the bridge didn't go back to DHCP and only a power cycle
+// (which resets the bridge too) recovers. /boot reports it as dhcpStuck.
+
+typedef enum {
+  w_IDLE       = 0,
+  w_CONNECTING = 1,
+  w_CONNECTED  = 2,
+  w_BACKOFF    = 3, // waiting to retry after a failed attempt or a drop
+} wifi_state;
+
+#define WIFI_CACHE_MAGIC       0x5743 // "WC"
+#define WIFI_CACHE_VERSION     1
+#define WIFI_CACHE_EEPROM_ADDR 16     // after the track catalog
+
+typedef struct {
+  uint16_t magic;
+  uint8_t  version;
+  uint8_t  reserved;
+  uint8_t  ip[4];
+  uint8_t  gateway[4];
+  uint8_t  subnet[4];
+  uint8_t  dns[4];
+  uint16_t checksum; // Fletcher-16 over the bytes above
+} wifi_cache;
+
+typedef struct {
+  wifi_state state;
+  unsigned long connects;       // successful associations
+  unsigned long reconnects;     // drops after being connected
+  unsigned long failures;       // attempts that timed out
+  unsigned long firstConnectMs; // millis() of the first association, 0 if none
+  unsigned long lastConnectMs;  // duration of the last successful attempt
+  bool usedCache;               // last attempt used the cached IP config
+  unsigned long cacheRejects;   // cached leases whose gateway didn't answer
+  bool dhcpStuck;               // DHCP fallback kept the rejected address
+} wifi_stats;
+
+void wifi_begin(const char *ssid, const char *password);
+void wifi_loop();
+bool wifi_connected();
+
+// True once per new association, so the caller can (re)start servers.
+bool wifi_justConnected();
+
+wifi_stats wifi_getStats();
+const char* wifiStateToStr(wifi_state s);
+
+// Pure helpers, exercised by the tests
+void wifiCacheMake(wifi_cache &c, const uint8_t ip[4], const uint8_t gateway[4],
+                   const uint8_t subnet[4], const uint8_t dns[4]);
+bool wifiCacheValid(const wifi_cache &c);
+unsigned long wifiBackoffMs(unsigned long failures);
@@ -4,11 +4,13 @@ import { WebView } from 'react-native-webview';
 import MaterialIcons from '@expo/vector-icons/MaterialIcons';
 import Slider from '@react-native-community/slider';
 import { useDriveCommands } from '../../hooks/use-drive-commands';
+import { useClockSync } from '../../hooks/use-clock-sync';
 import { useFocusEffect } from '@react-navigation/native';
 
 
 
 const CAMERA_URL = 'http://192.168.1.28';
+const ARDUINO_URL = 'http://192.168.1.18:8080';
 
 // Injected JavaScript that extracts video stream and runs object detection
 const INJECTED_JAVASCRIPT = `
@@ -282,6 +284,9 @@ true;
 
 export default function CameraScreen() {
   const { sendFollowCommand, stopCar } = useDriveCommands();
+  // Common timebase for glass-to-wheel latency (camera frames -> car)
+  useClockSync(CAMERA_URL);
+  useClockSync(ARDUINO_URL);
   const [loading, setLoading] = useState(true);
   const [error, setError] = useState<string | null>(null);
   const [modelStatus, setModelStatus] = useState('');
@@ -9,7 +9,7 @@ import { ThemedView } from '@/components/themed-view';
 const ARDUINO_IP = '192.168.1.18';//'172.20.10.6'; // Update this to match your Arduino IP
 const PORT = 8080;
 
-// Track names - matches Arduino order
+// Fallback track names until the Arduino's /mp3/tracks catalog has loaded
 const TRACK_NAMES: { [key: number]: string } = {
   1: 'deep in it by berlioz',
   2: 'I Am in Love by Jennifer Lara',
@@ -22,6 +22,18 @@ const TRACK_NAMES: { [key: number]: string } = {
 
 const TOTAL_TRACKS = 7;
 
+// How long the Arduino may hold a /mp3/status long-poll open
+const LONG_POLL_WAIT_MS = 20000;
+
+// Long-poll backoff: after a failed request (doubling up to the max), and
+// between requests when the Arduino answers without a version to wait on
+const LONG_POLL_RETRY_MS = 2000;
+const LONG_POLL_MAX_RETRY_MS = 30000;
+const LONG_POLL_NO_VERSION_MS = 1000;
+
+// Entries per /mp3/tracks request
+const TRACKS_PAGE_SIZE = 20;
+
 // Helper to get song name from track number
 const getSongName = (trackNumber: number): string => {
   return TRACK_NAMES[trackNumber] || `Track ${trackNumber}`;
@@ -51,101 +63,185 @@ const MP3Player: React.FC = () => {
   const prevScale = useRef(new Animated.Value(1)).current;
   const trackNameOpacity = useRef(new Animated.Value(1)).current;
 
-  // Fetch current state from Arduino
-  const fetchPlayerStatus = useCallback(async () => {
-    try {
-      const url = `http://${ARDUINO_IP}:${PORT}/mp3/status`;
-      const controller = new AbortController();
-      const timeoutId = setTimeout(() => controller.abort(), 2000); // 2 second timeout
+  // Last status version seen; lets /mp3/status long-poll for changes
+  const statusVersionRef = useRef(0);
+
+  // Track names from the Arduino's catalog, keyed by track number
+  const [trackNames, setTrackNames] = useState<{ [key: number]: string }>({});
+  const songName = useCallback(
+    (trackNumber: number) => trackNames[trackNumber] || getSongName(trackNumber),
+    [trackNames],
+  );
+
+  // Take a /mp3/status object (also nested as "mp3" in /state replies)
+  const applyStatus = useCallback((data: any) => {
+    if (typeof data.version === 'number') {
+      statusVersionRef.current = data.version;
+    }
+    setPlayerState((prev) => {
+      // Only update if values actually changed (prevents unnecessary re-renders)
+      const newIsPlaying = data.isPlaying === true;
+      const newVolume = data.volume !== undefined ? data.volume : prev.volume;
+      const newTrack = data.currentTrack !== undefined ? data.currentTrack : prev.currentTrack;
+      const newTotal = typeof data.maxTracks === 'number' ? data.maxTracks : prev.totalTracks;
+      const trackName = data.trackName || getSongName(newTrack);
+
       
+      // Always update trackName even if other values haven't changed
+      const shouldUpdate = prev.isPlaying !== newIsPlaying || 
+                           prev.volume !== newVolume || 
+                           prev.currentTrack !== newTrack ||
+                           prev.totalTracks !== newTotal ||
+                           prev.trackName !== trackName;
+      
+      if (!shouldUpdate) {
+        return prev; // No change, return same state
+      }
+      
+      return {
+        ...prev,
+        isPlaying: newIsPlaying,
+        volume: newVolume,
+        currentTrack: newTrack,
+        totalTracks: newTotal,
+        trackName: trackName, // Store track name from Arduino
+      };
+    });
+  }, []);
+
+  // Fetch current state from Arduino. With waitMs, the Arduino holds the
+  // request until the state differs from the version we already have.
+  // Aborting signal cancels the request early (e.g. on unmount).
+  const fetchPlayerStatus = useCallback(async (waitMs?: number, signal?: AbortSignal): Promise<boolean> => {
+    const controller = new AbortController();
+    const timeoutId = setTimeout(() => controller.abort(), (waitMs ?? 0) + 2000);
+    const onAbort = () => controller.abort();
+    signal?.addEventListener('abort', onAbort);
+    try {
+      let url = `http://${ARDUINO_IP}:${PORT}/mp3/status`;
+      if (waitMs && statusVersionRef.current) {
+        url += `?since=${statusVersionRef.current}&wait=${waitMs}`;
+      }
       const response = await fetch(url, {
         signal: controller.signal,
       });
       
-      clearTimeout(timeoutId);
-      
       if (response.ok) {
-        const data = await response.json();
-        console.log('Status data:', data); // Debug: see what Arduino is sending
-        setPlayerState((prev) => {
-          // Only update if values actually changed (prevents unnecessary re-renders)
-          const newIsPlaying = data.isPlaying === true;
-          const newVolume = data.volume !== undefined ? data.volume : prev.volume;
-          const newTrack = data.currentTrack !== undefined ? data.currentTrack : prev.currentTrack;
-          const trackName = data.trackName || getSongName(newTrack);
-          
-          console.log('Track name from Arduino:', data.trackName, 'Track number:', newTrack); // Debug
-          
-          // Always update trackName even if other values haven't changed
-          const shouldUpdate = prev.isPlaying !== newIsPlaying || 
-                               prev.volume !== newVolume || 
-                               prev.currentTrack !== newTrack ||
-                               prev.trackName !== trackName;
-          
-          if (!shouldUpdate) {
-            return prev; // No change, return same state
-          }
-          
-          return {
-            ...prev,
-            isPlaying: newIsPlaying,
-            volume: newVolume,
-            currentTrack: newTrack,
-            trackName: trackName, // Store track name from Arduino
-          };
-        });
+        applyStatus(await response.json());
+        return true;
       }
+      return false;
     } catch (error) {
       // Silently fail - don't spam console with errors
       // If we can't connect, keep current state (don't reset)
+      return false;
+    } finally {
+      clearTimeout(timeoutId);
+      signal?.removeEventListener('abort', onAbort);
     }
-  }, []);
+  }, [applyStatus]);
+
+  // Send an MP3 command through /state, whose reply carries the player
+  // status, so no follow-up status request is needed. True if applied.
+  const sendStateCommand = useCallback(async (query: string): Promise<boolean> => {
+    const response = await fetch(`http://${ARDUINO_IP}:${PORT}/state?${query}`);
+    if (!response.ok) return false;
+    const data = await response.json();
+    if (data.mp3) applyStatus(data.mp3);
+    return data.mp3Cmd === 'applied';
+  }, [applyStatus]);
 
   // Send HTTP request to Arduino for MP3 control
   const sendMP3Command = useCallback(async (command: 'play' | 'pause' | 'next' | 'previous') => {
-    const url = `http://${ARDUINO_IP}:${PORT}/mp3?cmd=${command}`;
     try {
-      const response = await fetch(url);
-      if (response.ok) {
-        // Fetch actual state from Arduino after command completes
-        // Reduced delay for faster updates
-        setTimeout(() => {
-          fetchPlayerStatus().then(() => {
-            setPlayerState((prev) => ({ ...prev, isLoading: false }));
-          });
-        }, 250);
-      } else {
-        setPlayerState((prev) => ({ ...prev, isLoading: false }));
+      if (!(await sendStateCommand(`cmd=${command}`))) {
         console.log('Error: MP3 command failed');
       }
     } catch (error) {
       console.log('Error sending MP3 command:', error);
-      setPlayerState((prev) => ({ ...prev, isLoading: false }));
     }
-  }, [fetchPlayerStatus]);
+    setPlayerState((prev) => ({ ...prev, isLoading: false }));
+  }, [sendStateCommand]);
 
   // Sync state when app loads
   useEffect(() => {
     fetchPlayerStatus();
   }, [fetchPlayerStatus]);
 
-  // Poll Arduino state periodically to detect physical button presses
-  // Use longer interval and prevent overlapping requests to reduce lag
-  const isPollingRef = useRef(false);
-  
+  // Load the track catalog a page at a time
+  useEffect(() => {
+    let cancelled = false;
+
+    const load = async () => {
+      const names: { [key: number]: string } = {};
+      let offset = 0;
+      let total = 1;
+      try {
+        while (!cancelled && offset < total) {
+          const response = await fetch(
+            `http://${ARDUINO_IP}:${PORT}/mp3/tracks?offset=${offset}&limit=${TRACKS_PAGE_SIZE}`,
+          );
+          if (!response.ok) return;
+          const data = await response.json();
+          total = data.total;
+          if (!data.tracks.length) break;
+          for (const t of data.tracks) names[t.track] = t.name;
+          offset += data.tracks.length;
+        }
+      } catch (error) {
+        // Keep the fallback names if the Arduino isn't reachable
+        return;
+      }
+      if (!cancelled) setTrackNames(names);
+    };
+    load();
+
+    return () => {
+      cancelled = true;
+    };
+  }, []);
+
+  // Long-poll Arduino state to pick up physical button presses and track
+  // changes. Each request is held open until the status version moves, so
+  // there's no fixed polling load on the Arduino.
   useEffect(() => {
-    const pollInterval = setInterval(() => {
-      // Only poll if not already fetching (prevents request queue)
-      if (!isPollingRef.current && !playerState.isLoading) {
-        isPollingRef.current = true;
-        fetchPlayerStatus().finally(() => {
-          isPollingRef.current = false;
+    const controller = new AbortController();
+    const { signal } = controller;
+
+    const sleep = (ms: number) =>
+      new Promise<void>((resolve) => {
+        const id = setTimeout(resolve, ms);
+        signal.addEventListener('abort', () => {
+          clearTimeout(id);
+          resolve();
         });
+      });
+
+    const run = async () => {
+      let retryMs = LONG_POLL_RETRY_MS;
+      while (!signal.aborted) {
+        const ok = await fetchPlayerStatus(LONG_POLL_WAIT_MS, signal);
+        if (signal.aborted) break;
+        if (!ok) {
+          // Arduino unreachable: back off before trying again
+          await sleep(retryMs);
+          retryMs = Math.min(retryMs * 2, LONG_POLL_MAX_RETRY_MS);
+          continue;
+        }
+        retryMs = LONG_POLL_RETRY_MS;
+        if (!statusVersionRef.current) {
+          // No version to wait on, so the Arduino answers straight away;
+          // don't turn that into a busy loop
+          await sleep(LONG_POLL_NO_VERSION_MS);
+        }
       }
-    }, 2000); // Check every 2 seconds for better responsiveness
+    };
+    run();
 
-    return () => clearInterval(pollInterval);
-  }, [fetchPlayerStatus, playerState.isLoading]);
+    return () => {
+      controller.abort();
+    };
+  }, [fetchPlayerStatus]);
 
   // Animate button press
   const animateButtonPress = (scale: Animated.Value) => {
@@ -181,13 +277,13 @@ const MP3Player: React.FC = () => {
 
   // Play a specific track
   const playTrack = useCallback(async (trackNumber: number) => {
-    if (trackNumber < 1 || trackNumber > TOTAL_TRACKS) return;
+    if (trackNumber < 1 || trackNumber > playerState.totalTracks) return;
     
     // Optimistically update UI immediately
     setPlayerState((prev) => ({
       ...prev,
       currentTrack: trackNumber,
-      trackName: getSongName(trackNumber),
+      trackName: songName(trackNumber),
       isPlaying: true,
       isLoading: true,
     }));
@@ -195,32 +291,17 @@ const MP3Player: React.FC = () => {
     // Animate track name update
     animateTrackNameUpdate();
     
-    const url = `http://${ARDUINO_IP}:${PORT}/mp3?track=${trackNumber}`;
     try {
-      const response = await fetch(url);
-      if (response.ok) {
-        // Sync state after playing track - reduced delay for faster updates
-        setTimeout(() => {
-          fetchPlayerStatus().then(() => {
-            setPlayerState((prev) => ({ ...prev, isLoading: false }));
-          });
-        }, 300);
-      } else {
-        setPlayerState((prev) => ({ ...prev, isLoading: false }));
-        // Re-fetch to get actual state
-        setTimeout(() => {
-          fetchPlayerStatus();
-        }, 250);
+      if (!(await sendStateCommand(`track=${trackNumber}`))) {
+        // Not applied: get the actual state back
+        fetchPlayerStatus();
       }
     } catch (error) {
       console.log('Error playing track:', error);
-      setPlayerState((prev) => ({ ...prev, isLoading: false }));
-      // Re-fetch to get actual state
-      setTimeout(() => {
-        fetchPlayerStatus();
-      }, 250);
+      fetchPlayerStatus();
     }
-  }, [fetchPlayerStatus]);
+    setPlayerState((prev) => ({ ...prev, isLoading: false }));
+  }, [fetchPlayerStatus, sendStateCommand, playerState.totalTracks, songName]);
 
   const handlePlayPause = () => {
     if (playerState.isLoading) return; // Prevent multiple clicks
@@ -250,14 +331,8 @@ const MP3Player: React.FC = () => {
     isLoading: true
   }));
 
+  // The reply carries the new track #
   sendMP3Command("next");
-
-  // After Arduino completes, fetch real track #
-  setTimeout(() => {
-    fetchPlayerStatus().then(() => {
-      setPlayerState(prev => ({ ...prev, isLoading: false }));
-    });
-  }, 350); // 300–400ms is correct for DFPlayer
 };
 
 
@@ -274,24 +349,17 @@ const MP3Player: React.FC = () => {
     }));
 
     sendMP3Command("previous");
-
-    setTimeout(() => {
-      fetchPlayerStatus().then(() => {
-        setPlayerState(prev => ({ ...prev, isLoading: false }));
-      });
-    }, 350);
   };
 
 
   // Send volume command to Arduino
   const sendVolumeCommand = useCallback(async (volume: number) => {
-    const url = `http://${ARDUINO_IP}:${PORT}/mp3?volume=${Math.round(volume)}`;
     try {
-      await fetch(url);
+      await sendStateCommand(`volume=${Math.round(volume)}`);
     } catch (error) {
       console.log('Error sending volume command:', error);
     }
-  }, []);
+  }, [sendStateCommand]);
 
   // Update UI immediately for smooth visual feedback (no HTTP request)
   const handleVolumeChange = (value: number) => {
@@ -327,7 +395,7 @@ const MP3Player: React.FC = () => {
             { opacity: trackNameOpacity }
           ]} 
           numberOfLines={2}>
-          {playerState.trackName || getSongName(playerState.currentTrack)}
+          {playerState.trackName || songName(playerState.currentTrack)}
         </Animated.Text>
         <ThemedText style={styles.trackSubtitle}>
           Track {playerState.currentTrack}
@@ -399,13 +467,13 @@ const MP3Player: React.FC = () => {
       <View style={styles.songListContainer}>
         <ThemedText style={styles.songListTitle}>Select Song</ThemedText>
         <ScrollView style={styles.songList} showsVerticalScrollIndicator={false}>
-          {Array.from({ length: TOTAL_TRACKS }, (_, i) => i + 1).map((trackNum) => (
+          {Array.from({ length: playerState.totalTracks }, (_, i) => i + 1).map((trackNum) => (
             <TouchableOpacity
               key={trackNum}
               style={[
                 styles.songItem,
                 playerState.currentTrack === trackNum && styles.songItemActive,
-                trackNum === TOTAL_TRACKS && styles.songItemLast,
+                trackNum === playerState.totalTracks && styles.songItemLast,
               ]}
               onPress={() => playTrack(trackNum)}
               disabled={playerState.isLoading}>
@@ -421,7 +489,7 @@ const MP3Player: React.FC = () => {
                     playerState.currentTrack === trackNum && styles.songItemTextActive,
                   ]}
                   numberOfLines={1}>
-                  {getSongName(trackNum)}
+                  {songName(trackNum)}
                 </ThemedText>
               </View>
               {playerState.currentTrack === trackNum && (
@@ -0,0 +1,75 @@
+import { useEffect, useRef } from 'react';
+
+const SYNC_INTERVAL_MS = 2000;
+// Forget the best sample after this long so drift can't go uncorrected
+const BEST_SAMPLE_MAX_AGE_MS = 30000;
+
+// Sub-millisecond phone clock on the same epoch as Date.now()
+const perfBaseMs = Date.now() - performance.now();
+export const phoneNowUs = (): number => Math.round((perfBaseMs + performance.now()) * 1000);
+
+export interface ClockEstimate {
+  offsetUs: number; // phone - device
+  rttUs: number;
+  takenAt: number;  // Date.now() when measured
+}
+
+// NTP-style sync of a device's clock (camera or controller /time endpoint).
+// Each round sends t0 plus the previous round's result so the device can
+// run its own offset/skew estimator; we keep the lowest-RTT estimate.
+export const useClockSync = (baseUrl: string, enabled = true) => {
+  const estimate = useRef<ClockEstimate | null>(null);
+
+  useEffect(() => {
+    if (!enabled) return;
+
+    let cancelled = false;
+    let inFlight = false;
+    let last: { off: number; rtt: number; at: number } | null = null;
+
+    const round = async () => {
+      if (inFlight) return;
+      inFlight = true;
+
+      const t0 = phoneNowUs();
+      let url = `${baseUrl}/time?t0=${t0}`;
+      if (last) {
+        url += `&off=${Math.round(last.off)}&rtt=${Math.round(last.rtt)}&at=${last.at}`;
+      }
+
+      try {
+        const response = await fetch(url);
+        const t3 = phoneNowUs();
+        const { t1, t2 } = await response.json();
+        if (cancelled) return;
+
+        const off = (t0 - t1 + (t3 - t2)) / 2;
+        const rtt = t3 - t0 - (t2 - t1);
+        last = { off, rtt, at: t1 };
+
+        const best = estimate.current;
+        const now = Date.now();
+        if (!best || rtt <= best.rttUs || now - best.takenAt > BEST_SAMPLE_MAX_AGE_MS) {
+          estimate.current = { offsetUs: off, rttUs: rtt, takenAt: now };
+        }
+      } catch {
+        // Device unreachable; try again next round
+      } finally {
+        inFlight = false;
+      }
+    };
+
+    round();
+    const interval = setInterval(round, SYNC_INTERVAL_MS);
+    return () => {
+      cancelled = true;
+      clearInterval(interval);
+    };
+  }, [baseUrl, enabled]);
+
+  // Map a device timestamp (us) onto the phone's clock
+  const toPhoneUs = (deviceUs: number): number | null =>
+    estimate.current ? deviceUs + estimate.current.offsetUs : null;
+
+  return { estimate, toPhoneUs };
+};
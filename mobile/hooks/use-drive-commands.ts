@@ -3,6 +3,9 @@ import { useCallback, useRef } from 'react';
 const ARDUINO_IP = '192.168.1.18';
 const PORT = 8080;
 const MAX_PWM = 255;
+// Resend unchanged commands this often so the car's link governor
+// doesn't mistake a steady joystick for a dead link.
+const KEEPALIVE_MS = 200;
 
 // Helper: clamp a value to [-max, max]
 function clamp(val: number, max: number): number {
@@ -11,18 +14,40 @@ function clamp(val: number, max: number): number {
   return val;
 }
 
+// Echo returned by /drive: this command's ids and receive time (car clock),
+// plus the last command the car's FSM actually applied. Once the car's
+// clock is synced, rxPhone/atPhone give those times on the phone's clock (us).
+export interface DriveEcho {
+  seq: number;
+  t: number;
+  rx: number;
+  rxPhone?: number;
+  tick: number;
+  applied: { seq: number; t: number; rx: number; at: number; atPhone?: number; tick: number };
+}
+
+export interface DriveLatency {
+  rttMs: number;         // phone send -> response received
+  echo: DriveEcho | null;
+}
+
 export const useDriveCommands = () => {
   const lastSentUD = useRef<number>(0);
   const lastSentLR = useRef<number>(0);
+  const lastSentAt = useRef<number>(0);
+  const nextSeq = useRef<number>(1);
+  const latency = useRef<DriveLatency>({ rttMs: 0, echo: null });
 
   const sendDriveCommand = useCallback(
     async (ud: number, lr: number, forceUpdate = false) => {
       const udClamped = clamp(ud, MAX_PWM);
       const lrClamped = clamp(lr, MAX_PWM);
 
-      // Don't spam very small changes unless forced
+      // Don't spam very small changes unless forced or due for a keepalive
+      const now = Date.now();
       if (
         !forceUpdate &&
+        now - lastSentAt.current < KEEPALIVE_MS &&
         Math.abs(udClamped - lastSentUD.current) < 3 &&
         Math.abs(lrClamped - lastSentLR.current) < 3
       ) {
@@ -31,10 +56,24 @@ export const useDriveCommands = () => {
 
       lastSentUD.current = udClamped;
       lastSentLR.current = lrClamped;
+      lastSentAt.current = now;
 
-      const url = `http://${ARDUINO_IP}:${PORT}/drive?ud=${udClamped}&lr=${lrClamped}`;
+      // t = send time (low 32 bits of ms) for the car's jitter buffer
+      const t = now >>> 0;
+      const seq = nextSeq.current++;
+      // /drive rather than /state: the echo is all this needs, and a
+      // command goes out every keepalive, so the reply stays small
+      const url = `http://${ARDUINO_IP}:${PORT}/drive?ud=${udClamped}&lr=${lrClamped}&t=${t}&seq=${seq}`;
       try {
-        await fetch(url);
+        const response = await fetch(url);
+        const rttMs = Date.now() - now;
+        let echo: DriveEcho | null = null;
+        try {
+          echo = await response.json();
+        } catch {
+          // older firmware replies with plain "OK"
+        }
+        latency.current = { rttMs, echo };
       } catch (e) {
         console.log('Error sending drive command:', e);
       }
@@ -61,6 +100,7 @@ export const useDriveCommands = () => {
   }, [sendDriveCommand]);
 
   return {
+    latency,
     sendDriveCommand,
     sendFollowCommand,
     stopCar,